@@ -0,0 +1,596 @@
+/**
+ * BBM 342 Operating Systems
+ * Experiment 1
+ * Matrix multiplication kernels
+ *
+ * The blocked kernel packs a kc x nc panel of B into a contiguous buffer
+ * and updates KERNEL_MR rows of C at a time with an i-k-j inner loop, so
+ * that every inner iteration walks contiguous memory and can be vectorized
+ * by the compiler. A kernel pool splits the rows of C between threads that
+ * are created once per process. Strassen's recursive algorithm may be put on
+ * top of them for big matrices. All arithmetic is done on unsigned long
+ * long, which wraps modulo 2^64 exactly like the two's complement long long
+ * results of the plain triple loop, therefore any summation order gives
+ * identical bits.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "kernel.h"
+
+#define DEFAULT_L1_SIZE (32L * 1024)
+#define DEFAULT_L2_SIZE (256L * 1024)
+
+typedef unsigned long long ull;
+
+static void micro_kernel_mr(int kb, int nb, const ull *a, int lda,
+                            const ull *bp, ull *c, int ldc);
+static void micro_kernel_1(int kb, int nb, const ull *a,
+                           const ull *bp, ull *c);
+static void* kernel_worker_routine(void *args);
+static void kernel_worker_part(kernel_worker_t *worker);
+static void add_blocks(int n, const ull *x, int ldx, const ull *y, int ldy,
+                       ull *z, int ldz, int subtract);
+static void update_block(int n, ull *z, int ldz, const ull *m, int ldm, int mode);
+
+/**
+ * Chooses tile sizes according to the cache sizes of the running machine.
+ * KERNEL_MR rows of C and one row of the packed panel should stay in half of
+ * the L1 data cache, and the whole packed panel in half of the L2 cache.
+ * @param tiles destination tile sizes
+ * @param n     matrix size, tiles are never larger than it
+ */
+void choose_tile_sizes(tile_sizes_t *tiles, int n) {
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (l1 <= 0) {
+        l1 = DEFAULT_L1_SIZE;
+    }
+    if (l2 <= 0) {
+        l2 = DEFAULT_L2_SIZE;
+    }
+
+    long nc = l1 / 2 / (long) (sizeof(long long) * (KERNEL_MR + 1));
+    nc = nc < 16 ? 16 : nc & ~7L; /* multiple of 8 for the vector loop */
+    long kc = l2 / 2 / (long) (sizeof(long long) * nc);
+    kc = kc < 16 ? 16 : kc;
+
+    tiles->nc = (int) (nc < n ? nc : n);
+    tiles->kc = (int) (kc < n ? kc : n);
+    if (tiles->nc < 1) {
+        tiles->nc = 1;
+    }
+    if (tiles->kc < 1) {
+        tiles->kc = 1;
+    }
+}
+
+/**
+ * Element count of the pack buffer that matrix_mult_blocked needs
+ * @param tiles tile sizes
+ * @return number of long long elements
+ */
+size_t pack_buffer_size(const tile_sizes_t *tiles) {
+    return (size_t) tiles->kc * (size_t) tiles->nc;
+}
+
+/**
+ * Cache-blocked matrix multiplication, C = A * B or C += A * B.
+ * Matrices are row major with the given leading dimensions, so sub-matrices
+ * of a bigger contiguous matrix can be passed directly.
+ * @param tiles         tile sizes, see choose_tile_sizes
+ * @param m             row count of A and C
+ * @param n             column count of B and C
+ * @param k             column count of A and row count of B
+ * @param a             matrix A
+ * @param lda           leading dimension of A
+ * @param b             matrix B
+ * @param ldb           leading dimension of B
+ * @param c             result matrix C, must not overlap A or B
+ * @param ldc           leading dimension of C
+ * @param accumulate    0 to overwrite C, otherwise add the product to C
+ * @param pack          pack buffer of pack_buffer_size elements, or NULL
+ */
+void matrix_mult_blocked(const tile_sizes_t *tiles, int m, int n, int k,
+                         const long long *a, int lda,
+                         const long long *b, int ldb,
+                         long long *c, int ldc,
+                         int accumulate, long long *pack) {
+    const ull *ua = (const ull *) a;
+    const ull *ub = (const ull *) b;
+    ull *uc = (ull *) c;
+    ull *up = (ull *) pack;
+
+    int i, p, jj, kk;
+    if (!accumulate) {
+        for (i = 0; i < m; ++i) {
+            memset(uc + (size_t) i * ldc, 0, sizeof(ull) * n);
+        }
+    }
+    if (m <= 0 || n <= 0 || k <= 0) {
+        return;
+    }
+
+    if (up == NULL) {
+        up = (ull *) malloc(sizeof(ull) * pack_buffer_size(tiles));
+        if (!up) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (jj = 0; jj < n; jj += tiles->nc) {
+        int nb = n - jj < tiles->nc ? n - jj : tiles->nc;
+        for (kk = 0; kk < k; kk += tiles->kc) {
+            int kb = k - kk < tiles->kc ? k - kk : tiles->kc;
+
+            /* pack B[kk..kk+kb)[jj..jj+nb) contiguously */
+            for (p = 0; p < kb; ++p) {
+                memcpy(up + (size_t) p * nb, ub + (size_t) (kk + p) * ldb + jj, sizeof(ull) * nb);
+            }
+
+            for (i = 0; i + KERNEL_MR <= m; i += KERNEL_MR) {
+                micro_kernel_mr(kb, nb, ua + (size_t) i * lda + kk, lda, up,
+                                uc + (size_t) i * ldc + jj, ldc);
+            }
+            for (; i < m; ++i) {
+                micro_kernel_1(kb, nb, ua + (size_t) i * lda + kk, up,
+                               uc + (size_t) i * ldc + jj);
+            }
+        }
+    }
+
+    if ((ull *) pack != up) {
+        free(up);
+    }
+}
+
+/**
+ * Updates KERNEL_MR rows of C with a packed panel
+ * @param kb    panel depth
+ * @param nb    panel width
+ * @param a     first element of the A block
+ * @param lda   leading dimension of A
+ * @param bp    packed panel, kb rows of nb elements
+ * @param c     first element of the C block
+ * @param ldc   leading dimension of C
+ */
+static void micro_kernel_mr(int kb, int nb, const ull *a, int lda,
+                            const ull *bp, ull *c, int ldc) {
+    ull *c0 = c;
+    ull *c1 = c + ldc;
+    ull *c2 = c + 2 * (size_t) ldc;
+    ull *c3 = c + 3 * (size_t) ldc;
+
+    int p, j;
+    for (p = 0; p < kb; ++p) {
+        ull a0 = a[p];
+        ull a1 = a[p + lda];
+        ull a2 = a[p + 2 * (size_t) lda];
+        ull a3 = a[p + 3 * (size_t) lda];
+        const ull *brow = bp + (size_t) p * nb;
+        for (j = 0; j < nb; ++j) {
+            ull bv = brow[j];
+            c0[j] += a0 * bv;
+            c1[j] += a1 * bv;
+            c2[j] += a2 * bv;
+            c3[j] += a3 * bv;
+        }
+    }
+}
+
+/**
+ * Updates a single row of C with a packed panel
+ * @param kb    panel depth
+ * @param nb    panel width
+ * @param a     first element of the A row
+ * @param bp    packed panel, kb rows of nb elements
+ * @param c     first element of the C row
+ */
+static void micro_kernel_1(int kb, int nb, const ull *a,
+                           const ull *bp, ull *c) {
+    int p, j;
+    for (p = 0; p < kb; ++p) {
+        ull av = a[p];
+        const ull *brow = bp + (size_t) p * nb;
+        for (j = 0; j < nb; ++j) {
+            c[j] += av * brow[j];
+        }
+    }
+}
+
+/**
+ * Creates a kernel pool. The calling thread works as the first member of
+ * the pool, so size - 1 threads are created.
+ * @param size  thread count, 0 or less means online processor count
+ * @return pointer of an kernel_pool_t
+ */
+kernel_pool_t* create_kernel_pool(int size) {
+    if (size <= 0) {
+        size = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        size = size > 0 ? size : 1;
+    }
+
+    kernel_pool_t *pool = (kernel_pool_t *) malloc(sizeof(kernel_pool_t));
+    if (!pool) {
+        exit(EXIT_FAILURE);
+    }
+    pool->workers = (kernel_worker_t *) malloc(size * sizeof(kernel_worker_t));
+    if (!pool->workers) {
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->size = size;
+    pool->generation = 0;
+    pool->pending = 0;
+    pool->quit = 0;
+
+    int i;
+    for (i = 0; i < size; ++i) {
+        kernel_worker_t *worker = pool->workers + i;
+        worker->pool = pool;
+        worker->index = i;
+        worker->pack = NULL;
+        worker->pack_size = 0;
+        if (i > 0 && pthread_create(&worker->thread, NULL, kernel_worker_routine, (void *) worker)) {
+            fprintf(stderr, "Create kernel thread failed.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return pool;
+}
+
+/**
+ * Stops the threads of the pool and deallocates it.
+ * @param pool pointer of an kernel_pool_t
+ */
+void destroy_kernel_pool(kernel_pool_t *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    int i;
+    for (i = 0; i < pool->size; ++i) {
+        if (i > 0) {
+            pthread_join(pool->workers[i].thread, NULL);
+        }
+        free(pool->workers[i].pack);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool);
+}
+
+/**
+ * Multiplication with the threads of the pool, C = A * B or C += A * B.
+ * Every thread takes a band of rows of C. Please see matrix_mult_blocked for
+ * the parameters.
+ * @param pool  pointer of an kernel_pool_t, NULL to use only this thread
+ */
+void pool_matrix_mult(kernel_pool_t *pool, int m, int n, int k,
+                      const long long *a, int lda,
+                      const long long *b, int ldb,
+                      long long *c, int ldc, int accumulate) {
+    tile_sizes_t tiles;
+    choose_tile_sizes(&tiles, n > k ? n : k);
+    if (pool == NULL || pool->size == 1 || m < 2 * KERNEL_MR) {
+        long long *pack = NULL;
+        if (pool != NULL) {
+            kernel_worker_t *worker = pool->workers;
+            if (worker->pack_size < pack_buffer_size(&tiles)) {
+                free(worker->pack);
+                worker->pack_size = pack_buffer_size(&tiles);
+                worker->pack = (long long *) malloc(sizeof(long long) * worker->pack_size);
+                if (!worker->pack) {
+                    exit(EXIT_FAILURE);
+                }
+            }
+            pack = worker->pack;
+        }
+        matrix_mult_blocked(&tiles, m, n, k, a, lda, b, ldb, c, ldc, accumulate, pack);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->tiles = tiles;
+    pool->m = m;
+    pool->n = n;
+    pool->k = k;
+    pool->a = a;
+    pool->b = b;
+    pool->c = c;
+    pool->lda = lda;
+    pool->ldb = ldb;
+    pool->ldc = ldc;
+    pool->accumulate = accumulate;
+    pool->pending = pool->size - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    kernel_worker_part(pool->workers);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Subroutine for kernel threads. Waits for jobs and does its part of them.
+ * @param args pointer of an kernel_worker_t
+ * @return NULL
+ */
+static void* kernel_worker_routine(void *args) {
+    kernel_worker_t *worker = (kernel_worker_t *) args;
+    kernel_pool_t *pool = worker->pool;
+    unsigned long seen = 0;
+
+    while (1) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->generation == seen && !pool->quit) {
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        kernel_worker_part(worker);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->pending == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+/**
+ * Multiplies the band of rows of the current job that belongs to the worker.
+ * Bands are multiples of KERNEL_MR rows.
+ * @param worker pointer of an kernel_worker_t
+ */
+static void kernel_worker_part(kernel_worker_t *worker) {
+    kernel_pool_t *pool = worker->pool;
+    int band = (pool->m + pool->size - 1) / pool->size;
+    band = (band + KERNEL_MR - 1) / KERNEL_MR * KERNEL_MR;
+
+    int first = worker->index * band;
+    int last = first + band < pool->m ? first + band : pool->m;
+    if (first >= last) {
+        return;
+    }
+
+    size_t size = pack_buffer_size(&pool->tiles);
+    if (worker->pack_size < size) {
+        free(worker->pack);
+        worker->pack = (long long *) malloc(sizeof(long long) * size);
+        if (!worker->pack) {
+            exit(EXIT_FAILURE);
+        }
+        worker->pack_size = size;
+    }
+
+    matrix_mult_blocked(&pool->tiles, last - first, pool->n, pool->k,
+                        pool->a + (size_t) first * pool->lda, pool->lda,
+                        pool->b, pool->ldb,
+                        pool->c + (size_t) first * pool->ldc, pool->ldc,
+                        pool->accumulate, worker->pack);
+}
+
+/**
+ * Element count of the workspace that strassen_matrix_mult needs. Every
+ * recursion level takes three half size blocks and the seven sub-products
+ * of a level reuse the same space one after another.
+ * @param n         matrix size
+ * @param cutoff    size at which the blocked kernel is used
+ * @return number of long long elements
+ */
+size_t strassen_workspace_size(int n, int cutoff) {
+    size_t size = 0;
+    while (n > cutoff && n > 1) {
+        if (n & 1) {
+            n--; /* odd sizes are peeled */
+            continue;
+        }
+        n /= 2;
+        size += 3 * (size_t) n * n;
+    }
+    return size;
+}
+
+/**
+ * Makes sure that an arena has at least size elements. Memory is kept for
+ * the next multiplications.
+ * @param arena pointer of an kernel_arena_t
+ * @param size  element count
+ */
+void reserve_arena(kernel_arena_t *arena, size_t size) {
+    if (arena->size >= size) {
+        return;
+    }
+    free(arena->base);
+    arena->base = (long long *) malloc(sizeof(long long) * (size > 0 ? size : 1));
+    if (!arena->base) {
+        exit(EXIT_FAILURE);
+    }
+    arena->size = size;
+}
+
+/**
+ * Deallocates memory of an arena.
+ * @param arena pointer of an kernel_arena_t
+ */
+void free_arena(kernel_arena_t *arena) {
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+}
+
+/**
+ * Strassen's square matrix multiplication, C = A * B. Recursion stops at
+ * the cutoff size and the blocked kernel (with the threads of the pool) is
+ * used under it. An odd size is split to an even one and a last row and
+ * column. Results are identical to the blocked kernel since all operations
+ * are done modulo 2^64.
+ * @param pool      kernel threads, NULL for only this thread
+ * @param n         matrix size
+ * @param a         matrix A
+ * @param lda       leading dimension of A
+ * @param b         matrix B
+ * @param ldb       leading dimension of B
+ * @param c         result matrix C, must not overlap A, B or the workspace
+ * @param ldc       leading dimension of C
+ * @param cutoff    size at which the blocked kernel is used
+ * @param workspace strassen_workspace_size(n, cutoff) elements
+ */
+void strassen_matrix_mult(kernel_pool_t *pool, int n,
+                          const long long *a, int lda,
+                          const long long *b, int ldb,
+                          long long *c, int ldc,
+                          int cutoff, long long *workspace) {
+    if (n <= cutoff || n <= 1) {
+        pool_matrix_mult(pool, n, n, n, a, lda, b, ldb, c, ldc, 0);
+        return;
+    }
+
+    if (n & 1) {
+        int m = n - 1;
+        /* C11 = A11 * B11 + A12 * B21, then the last column and row */
+        strassen_matrix_mult(pool, m, a, lda, b, ldb, c, ldc, cutoff, workspace);
+        pool_matrix_mult(pool, m, m, 1, a + m, lda, b + (size_t) m * ldb, ldb, c, ldc, 1);
+        pool_matrix_mult(pool, m, 1, n, a, lda, b + m, ldb, c + m, ldc, 0);
+        pool_matrix_mult(pool, 1, n, n, a + (size_t) m * lda, lda, b, ldb, c + (size_t) m * ldc, ldc, 0);
+        return;
+    }
+
+    int h = n / 2;
+    size_t hh = (size_t) h * h;
+    const ull *a11 = (const ull *) a, *a12 = a11 + h;
+    const ull *a21 = a11 + (size_t) h * lda, *a22 = a21 + h;
+    const ull *b11 = (const ull *) b, *b12 = b11 + h;
+    const ull *b21 = b11 + (size_t) h * ldb, *b22 = b21 + h;
+    ull *c11 = (ull *) c, *c12 = c11 + h;
+    ull *c21 = c11 + (size_t) h * ldc, *c22 = c21 + h;
+
+    ull *s = (ull *) workspace;   /* sum of A blocks */
+    ull *t = s + hh;              /* sum of B blocks */
+    ull *m = t + hh;              /* product */
+    long long *deeper = (long long *) (m + hh);
+
+    /* M1 = (A11 + A22)(B11 + B22), C11 = M1, C22 = M1 */
+    add_blocks(h, a11, lda, a22, lda, s, h, 0);
+    add_blocks(h, b11, ldb, b22, ldb, t, h, 0);
+    strassen_matrix_mult(pool, h, (long long *) s, h, (long long *) t, h, (long long *) m, h, cutoff, deeper);
+    update_block(h, c11, ldc, m, h, 0);
+    update_block(h, c22, ldc, m, h, 0);
+
+    /* M2 = (A21 + A22) B11, C21 = M2, C22 -= M2 */
+    add_blocks(h, a21, lda, a22, lda, s, h, 0);
+    strassen_matrix_mult(pool, h, (long long *) s, h, (const long long *) b11, ldb, (long long *) m, h, cutoff, deeper);
+    update_block(h, c21, ldc, m, h, 0);
+    update_block(h, c22, ldc, m, h, -1);
+
+    /* M3 = A11 (B12 - B22), C12 = M3, C22 += M3 */
+    add_blocks(h, b12, ldb, b22, ldb, t, h, 1);
+    strassen_matrix_mult(pool, h, (const long long *) a11, lda, (long long *) t, h, (long long *) m, h, cutoff, deeper);
+    update_block(h, c12, ldc, m, h, 0);
+    update_block(h, c22, ldc, m, h, 1);
+
+    /* M4 = A22 (B21 - B11), C11 += M4, C21 += M4 */
+    add_blocks(h, b21, ldb, b11, ldb, t, h, 1);
+    strassen_matrix_mult(pool, h, (const long long *) a22, lda, (long long *) t, h, (long long *) m, h, cutoff, deeper);
+    update_block(h, c11, ldc, m, h, 1);
+    update_block(h, c21, ldc, m, h, 1);
+
+    /* M5 = (A11 + A12) B22, C11 -= M5, C12 += M5 */
+    add_blocks(h, a11, lda, a12, lda, s, h, 0);
+    strassen_matrix_mult(pool, h, (long long *) s, h, (const long long *) b22, ldb, (long long *) m, h, cutoff, deeper);
+    update_block(h, c11, ldc, m, h, -1);
+    update_block(h, c12, ldc, m, h, 1);
+
+    /* M6 = (A21 - A11)(B11 + B12), C22 += M6 */
+    add_blocks(h, a21, lda, a11, lda, s, h, 1);
+    add_blocks(h, b11, ldb, b12, ldb, t, h, 0);
+    strassen_matrix_mult(pool, h, (long long *) s, h, (long long *) t, h, (long long *) m, h, cutoff, deeper);
+    update_block(h, c22, ldc, m, h, 1);
+
+    /* M7 = (A12 - A22)(B21 + B22), C11 += M7 */
+    add_blocks(h, a12, lda, a22, lda, s, h, 1);
+    add_blocks(h, b21, ldb, b22, ldb, t, h, 0);
+    strassen_matrix_mult(pool, h, (long long *) s, h, (long long *) t, h, (long long *) m, h, cutoff, deeper);
+    update_block(h, c11, ldc, m, h, 1);
+}
+
+/**
+ * Z = X + Y or Z = X - Y on n x n blocks
+ * @param n         block size
+ * @param x         block X
+ * @param ldx       leading dimension of X
+ * @param y         block Y
+ * @param ldy       leading dimension of Y
+ * @param z         destination block Z
+ * @param ldz       leading dimension of Z
+ * @param subtract  nonzero for X - Y
+ */
+static void add_blocks(int n, const ull *x, int ldx, const ull *y, int ldy,
+                       ull *z, int ldz, int subtract) {
+    int i, j;
+    for (i = 0; i < n; ++i) {
+        const ull *xr = x + (size_t) i * ldx;
+        const ull *yr = y + (size_t) i * ldy;
+        ull *zr = z + (size_t) i * ldz;
+        if (subtract) {
+            for (j = 0; j < n; ++j) {
+                zr[j] = xr[j] - yr[j];
+            }
+        } else {
+            for (j = 0; j < n; ++j) {
+                zr[j] = xr[j] + yr[j];
+            }
+        }
+    }
+}
+
+/**
+ * Z = M, Z += M or Z -= M on n x n blocks
+ * @param n     block size
+ * @param z     destination block Z
+ * @param ldz   leading dimension of Z
+ * @param m     block M
+ * @param ldm   leading dimension of M
+ * @param mode  0 to copy, positive to add, negative to subtract
+ */
+static void update_block(int n, ull *z, int ldz, const ull *m, int ldm, int mode) {
+    int i, j;
+    for (i = 0; i < n; ++i) {
+        ull *zr = z + (size_t) i * ldz;
+        const ull *mr = m + (size_t) i * ldm;
+        if (mode == 0) {
+            memcpy(zr, mr, sizeof(ull) * n);
+        } else if (mode > 0) {
+            for (j = 0; j < n; ++j) {
+                zr[j] += mr[j];
+            }
+        } else {
+            for (j = 0; j < n; ++j) {
+                zr[j] -= mr[j];
+            }
+        }
+    }
+}
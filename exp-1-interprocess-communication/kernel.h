@@ -0,0 +1,77 @@
+#ifndef BBM342_EXP1_KERNEL_H
+#define BBM342_EXP1_KERNEL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* Rows of C updated together by the micro-kernel */
+#define KERNEL_MR 4
+
+typedef struct tile_sizes {
+    int kc; /* depth of a packed B panel (rows of B) */
+    int nc; /* width of a packed B panel (columns of B) */
+} tile_sizes_t;
+
+typedef struct kernel_pool kernel_pool_t;
+
+/* Part of a multiplication that is done by one thread of the pool */
+typedef struct kernel_worker {
+    kernel_pool_t *pool;
+    pthread_t thread;
+    int index;
+    long long *pack;
+    size_t pack_size;
+} kernel_worker_t;
+
+/* Threads that are created once and share every multiplication by rows */
+struct kernel_pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    kernel_worker_t *workers;
+    int size;
+    unsigned long generation; /* incremented for every job */
+    int pending;              /* workers that have not finished the job */
+    int quit;
+
+    /* current job, C = A * B or C += A * B */
+    tile_sizes_t tiles;
+    int m, n, k;
+    const long long *a, *b;
+    long long *c;
+    int lda, ldb, ldc;
+    int accumulate;
+};
+
+void choose_tile_sizes(tile_sizes_t *tiles, int n);
+size_t pack_buffer_size(const tile_sizes_t *tiles);
+
+void matrix_mult_blocked(const tile_sizes_t *tiles, int m, int n, int k,
+                         const long long *a, int lda,
+                         const long long *b, int ldb,
+                         long long *c, int ldc,
+                         int accumulate, long long *pack);
+
+/* Preallocated workspace of the recursive multiplication */
+typedef struct kernel_arena {
+    long long *base;
+    size_t size; /* element count */
+} kernel_arena_t;
+
+kernel_pool_t* create_kernel_pool(int size);
+void destroy_kernel_pool(kernel_pool_t *pool);
+void pool_matrix_mult(kernel_pool_t *pool, int m, int n, int k,
+                      const long long *a, int lda,
+                      const long long *b, int ldb,
+                      long long *c, int ldc, int accumulate);
+
+size_t strassen_workspace_size(int n, int cutoff);
+void reserve_arena(kernel_arena_t *arena, size_t size);
+void free_arena(kernel_arena_t *arena);
+void strassen_matrix_mult(kernel_pool_t *pool, int n,
+                          const long long *a, int lda,
+                          const long long *b, int ldb,
+                          long long *c, int ldc,
+                          int cutoff, long long *workspace);
+
+#endif
@@ -0,0 +1,384 @@
+/**
+ * BBM 342 Operating Systems
+ * Experiment 1
+ * Matrix input and output formats
+ *
+ * Text files hold the size of every matrix followed by its elements, which
+ * may be separated by commas and white spaces like "matrix.txt". Binary
+ * files hold a matrix_header_t and n * n native long long elements for every
+ * matrix. Regular files are mapped with mmap and parsed or copied in place,
+ * other inputs (stdin) are read in big chunks.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "matrix_io.h"
+#include "transport.h"
+
+#define READER_CHUNK    (1 << 16)
+#define NUMBER_LENGTH   32 /* longer than any long long with its sign */
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static size_t ensure_bytes(matrix_reader_t *reader, size_t need);
+static int parse_number(matrix_reader_t *reader, long long *value);
+
+/**
+ * Opens a matrix file and detects its format.
+ * @param path  file path, "-" for stdin
+ * @return pointer of an matrix_reader_t, NULL if the file cannot be opened
+ */
+matrix_reader_t* open_matrix_reader(const char *path) {
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    matrix_reader_t *reader = (matrix_reader_t *) malloc(sizeof(matrix_reader_t));
+    if (!reader) {
+        exit(EXIT_FAILURE);
+    }
+    memset(reader, 0, sizeof(matrix_reader_t));
+    reader->fd = fd;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+            reader->buffer = (char *) map;
+            reader->length = (size_t) st.st_size;
+            reader->capacity = reader->length;
+            reader->mapped = 1;
+            reader->eof = 1;
+        }
+    }
+    if (!reader->mapped) {
+        reader->capacity = READER_CHUNK;
+        reader->buffer = (char *) malloc(reader->capacity);
+        if (!reader->buffer) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    reader->binary = ensure_bytes(reader, 4) >= 4 &&
+                     memcmp(reader->buffer + reader->pos, MATRIX_MAGIC, 4) == 0;
+    return reader;
+}
+
+/**
+ * Reads the size of the next matrix.
+ * @param reader pointer of an matrix_reader_t
+ * @return size of the matrix, 0 at the end of the file, on a bad header or
+ * if a mapped file is too short for the matrix
+ */
+int next_matrix_size(matrix_reader_t *reader) {
+    if (reader->binary) {
+        matrix_header_t header;
+        if (ensure_bytes(reader, sizeof(header)) < sizeof(header)) {
+            return 0;
+        }
+        memcpy(&header, reader->buffer + reader->pos, sizeof(header));
+        reader->pos += sizeof(header);
+        if (memcmp(header.magic, MATRIX_MAGIC, 4) != 0 || header.type != MATRIX_TYPE_INT64) {
+            fprintf(stderr, "Unsupported matrix header.\n");
+            return 0;
+        }
+        if (header.n <= 0) {
+            return 0;
+        }
+        /* a stream is checked by read_matrix_values, once it is read */
+        if (reader->mapped && (unsigned long long) header.n * header.n >
+                              (reader->length - reader->pos) / sizeof(long long)) {
+            fprintf(stderr, "Matrix of size %d is longer than the file.\n", header.n);
+            return 0;
+        }
+        return header.n;
+    }
+
+    long long n;
+    if (!parse_number(reader, &n) || n <= 0 || n > 0x7fffffff) {
+        return 0;
+    }
+    return (int) n;
+}
+
+/**
+ * Reads the elements of the matrix whose size is returned by
+ * next_matrix_size.
+ * @param reader    pointer of an matrix_reader_t
+ * @param matrix    destination, n * n contiguous elements
+ * @param n         matrix size
+ * @return 1 on success, 0 if the file ends before the matrix
+ */
+int read_matrix_values(matrix_reader_t *reader, long long *matrix, int n) {
+    size_t count = (size_t) n * n;
+    if (!reader->binary) {
+        size_t i;
+        for (i = 0; i < count; ++i) {
+            if (!parse_number(reader, matrix + i)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    size_t size = sizeof(long long) * count;
+    size_t buffered = reader->length - reader->pos;
+    if (buffered >= size) {
+        memcpy(matrix, reader->buffer + reader->pos, size);
+        reader->pos += size;
+        return 1;
+    }
+    if (reader->mapped) {
+        return 0;
+    }
+
+    /* copy what is buffered and read the rest directly */
+    memcpy(matrix, reader->buffer + reader->pos, buffered);
+    reader->pos = reader->length;
+    return read_full(reader->fd, (char *) matrix + buffered, size - buffered);
+}
+
+/**
+ * Closes the file of the reader and deallocates it.
+ * @param reader pointer of an matrix_reader_t
+ */
+void close_matrix_reader(matrix_reader_t *reader) {
+    if (reader->mapped) {
+        munmap(reader->buffer, reader->length);
+    } else {
+        free(reader->buffer);
+    }
+    if (reader->fd != STDIN_FILENO) {
+        close(reader->fd);
+    }
+    free(reader);
+}
+
+/**
+ * Writes the decimal representation of a number, without terminating null.
+ * Two digits are produced at a time from a table.
+ * @param dst   destination, at least 20 bytes
+ * @param value the number
+ * @return length of the representation
+ */
+int format_long_long(char *dst, long long value) {
+    char tmp[NUMBER_LENGTH];
+    char *p = tmp + sizeof(tmp);
+    unsigned long long u = value < 0 ? 0ULL - (unsigned long long) value : (unsigned long long) value;
+
+    while (u >= 100) {
+        unsigned int pair = (unsigned int) (u % 100) * 2;
+        u /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (u >= 10) {
+        unsigned int pair = (unsigned int) u * 2;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    } else {
+        *--p = (char) ('0' + u);
+    }
+    if (value < 0) {
+        *--p = '-';
+    }
+
+    int length = (int) (tmp + sizeof(tmp) - p);
+    memcpy(dst, p, (size_t) length);
+    return length;
+}
+
+/**
+ * Writes a matrix in the binary format with a single writev.
+ * @param fd        file descriptor
+ * @param matrix    contiguous matrix
+ * @param n         matrix size
+ * @return 1 on success, 0 on error
+ */
+int write_matrix_binary(int fd, const long long *matrix, int n) {
+    matrix_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MATRIX_MAGIC, 4);
+    header.version = MATRIX_VERSION;
+    header.type = MATRIX_TYPE_INT64;
+    header.n = n;
+
+    struct iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void *) matrix;
+    iov[1].iov_len = sizeof(long long) * n * n;
+    return writev_full(fd, iov, 2);
+}
+
+/**
+ * Converts a text matrix file to the binary format or a binary one to the
+ * text format.
+ * @param input     input path, "-" for stdin
+ * @param output    output path, "-" for stdout
+ * @return number of converted matrices, -1 on error
+ */
+int convert_matrices(const char *input, const char *output) {
+    matrix_reader_t *reader = open_matrix_reader(input);
+    if (reader == NULL) {
+        fprintf(stderr, "Cannot open %s.\n", input);
+        return -1;
+    }
+    int out = strcmp(output, "-") == 0 ? STDOUT_FILENO : open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        fprintf(stderr, "Cannot open %s.\n", output);
+        close_matrix_reader(reader);
+        return -1;
+    }
+
+    long long *matrix = NULL;
+    char *line = NULL;
+    size_t capacity = 0;
+    int count = 0;
+    int n;
+    while ((n = next_matrix_size(reader)) > 0) {
+        size_t elements = (size_t) n * n;
+        if (elements > capacity) {
+            free(matrix);
+            free(line);
+            capacity = elements;
+            matrix = (long long *) malloc(sizeof(long long) * elements);
+            line = (char *) malloc((size_t) (NUMBER_LENGTH + 1) * n + 2);
+            if (!matrix || !line) {
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (!read_matrix_values(reader, matrix, n)) {
+            fprintf(stderr, "Matrix %d is truncated.\n", count + 1);
+            break;
+        }
+
+        if (reader->binary) {
+            int length = sprintf(line, "%d\n", n);
+            write_full(out, line, (size_t) length);
+
+            int i, j;
+            for (i = 0; i < n; ++i) {
+                char *p = line;
+                for (j = 0; j < n; ++j) {
+                    p += format_long_long(p, matrix[(size_t) i * n + j]);
+                    *p++ = j + 1 < n ? ',' : '\n';
+                }
+                write_full(out, line, (size_t) (p - line));
+            }
+        } else {
+            write_matrix_binary(out, matrix, n);
+        }
+        count++;
+    }
+
+    free(matrix);
+    free(line);
+    if (out != STDOUT_FILENO) {
+        close(out);
+    }
+    close_matrix_reader(reader);
+    return count;
+}
+
+/**
+ * Makes sure that at least need bytes are buffered unless the file ends.
+ * @param reader    pointer of an matrix_reader_t
+ * @param need      required byte count
+ * @return buffered byte count
+ */
+static size_t ensure_bytes(matrix_reader_t *reader, size_t need) {
+    size_t available = reader->length - reader->pos;
+    if (available >= need || reader->eof) {
+        return available;
+    }
+
+    /* move the unread bytes to the front and fill the rest */
+    memmove(reader->buffer, reader->buffer + reader->pos, available);
+    reader->length = available;
+    reader->pos = 0;
+    if (need > reader->capacity) {
+        reader->capacity = need;
+        reader->buffer = (char *) realloc(reader->buffer, reader->capacity);
+        if (!reader->buffer) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    while (reader->length < need) {
+        ssize_t r = read(reader->fd, reader->buffer + reader->length, reader->capacity - reader->length);
+        if (r <= 0) {
+            reader->eof = 1;
+            break;
+        }
+        reader->length += (size_t) r;
+    }
+    return reader->length;
+}
+
+/**
+ * Parses the next decimal number of a text file. Any other character than
+ * digits and signs is a separator. A sign without digits, a number longer
+ * than NUMBER_LENGTH and one out of the range of long long are malformed.
+ * @param reader    pointer of an matrix_reader_t
+ * @param value     destination
+ * @return 1 on success, 0 at the end of the file or on a malformed number
+ */
+static int parse_number(matrix_reader_t *reader, long long *value) {
+    const char *p, *end;
+    while (1) {
+        ensure_bytes(reader, NUMBER_LENGTH);
+        p = reader->buffer + reader->pos;
+        end = reader->buffer + reader->length;
+        while (p < end && (unsigned) (*p - '0') > 9 && *p != '-' && *p != '+') {
+            p++;
+        }
+        reader->pos = (size_t) (p - reader->buffer);
+        if (p < end) {
+            break;
+        }
+        if (reader->eof) {
+            return 0;
+        }
+    }
+
+    /* the whole number is buffered now */
+    ensure_bytes(reader, NUMBER_LENGTH);
+    p = reader->buffer + reader->pos;
+    end = reader->buffer + reader->length;
+
+    int negative = *p == '-';
+    p += (*p == '-' || *p == '+');
+    unsigned long long limit = negative ? 0x8000000000000000ULL : 0x7fffffffffffffffULL;
+    unsigned long long u = 0;
+    unsigned digit;
+    int overflow = 0;
+    const char *first = p;
+    while (p < end && (digit = (unsigned) (*p - '0')) <= 9) {
+        overflow |= u > (limit - digit) / 10;
+        u = u * 10 + digit;
+        p++;
+    }
+    reader->pos = (size_t) (p - reader->buffer);
+    if (p == first || overflow || p - first >= NUMBER_LENGTH - 1) { /* a shorter one is buffered up to its end */
+        fprintf(stderr, "Malformed number in the input.\n");
+        return 0;
+    }
+
+    *value = (long long) (negative ? 0ULL - u : u);
+    return 1;
+}
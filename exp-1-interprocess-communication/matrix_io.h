@@ -0,0 +1,40 @@
+#ifndef BBM342_EXP1_MATRIX_IO_H
+#define BBM342_EXP1_MATRIX_IO_H
+
+#include <stddef.h>
+
+#define MATRIX_MAGIC        "BBMX"
+#define MATRIX_VERSION      1
+#define MATRIX_TYPE_INT64   1
+
+/* Header of every matrix in a binary file, followed by n * n elements */
+typedef struct matrix_header {
+    char magic[4];
+    unsigned short version;
+    unsigned short type;
+    int n;
+    int reserved; /* keeps the elements 8 byte aligned */
+} matrix_header_t;
+
+/* Sequential reader of text or binary matrix files */
+typedef struct matrix_reader {
+    int fd;
+    int binary;
+    int mapped;     /* buffer is an mmap of the whole file */
+    char *buffer;
+    size_t capacity;
+    size_t length;  /* valid bytes in buffer */
+    size_t pos;     /* next unread byte */
+    int eof;        /* nothing more to read into buffer */
+} matrix_reader_t;
+
+matrix_reader_t* open_matrix_reader(const char *path);
+int next_matrix_size(matrix_reader_t *reader);
+int read_matrix_values(matrix_reader_t *reader, long long *matrix, int n);
+void close_matrix_reader(matrix_reader_t *reader);
+
+int format_long_long(char *dst, long long value);
+int write_matrix_binary(int fd, const long long *matrix, int n);
+int convert_matrices(const char *input, const char *output);
+
+#endif
@@ -5,36 +5,37 @@
  *
  * Compile: make
  *
- * Run:     ./process <process_count>
- * Note:    Also needs text file named "matrix.txt". Please see INPUT_FILE macro
+ * Run:     ./process [-z | -p | -S density] [-q] [-B] [-t threads] [-r cutoff]
+ *                    [-T stats] [-i input] <process_count>
+ *          ./process [-i input] -C output
+ *          ./process [-t threads] [-r cutoff] -D socket <process_count>
+ *          ./process [-q] [-B] [-i input] -c socket <steps>
+ * Note:    Also needs text file named "matrix.txt" if no input is given.
+ *          Please see INPUT_FILE macro
  *
  * Tags: process, pipe, unix
  * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <fcntl.h>
 #include <unistd.h>
 
-#define INPUT_FILE  ((const char *) "matrix.txt")
+#include "process.h"
+#include "service.h"
+#include "tiles.h"
 
-/* Function prototypes */
-void main_work(int** pipefd, int pcount);
-void child_work(int** pipefd, int pnum, int pcount);
-
-int** create_pipefd(int pcount);
-void close_pipefd(int** pipefd, int pnum, int pcount);
-void free_pipefd(int** pipefd, int pcount);
-
-long long** square_matrix_mult(long long** matrix, int n);
-long long** scan_matrix(FILE* matrixFile, int n);
-void print_matrix(long long** matrix, int n, int pnum);
-int max_length_in_matrix(long long** matrix, int n);
-int digit_count(long long number);
-
-void malloc_2d_long(long long*** array, int m, int n);
-void free_2d_long(long long*** array);
+#define INPUT_FILE      ((const char *) "matrix.txt")
+#define PRINT_BLOCK     (1 << 20)   /* bytes of formatted rows per write */
+#define PRINT_NUMBER    32          /* longer than any formatted long long */
 
 /**
  * Main function
@@ -46,16 +47,126 @@ void free_2d_long(long long*** array);
  * @see child_work
  */
 int main (int argc, char** argv) {
-    if (argc < 2) {
-        printf("Usage: %s <process_count>\n", argv[0]);
+    options_t options;
+    memset(&options, 0, sizeof(options));
+    options.threads = 1;
+    options.input = INPUT_FILE;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "zt:i:C:qBr:pS:T:D:c:")) != -1) {
+        switch (opt) {
+            case 'z':
+                options.shared_memory = 1;
+                break;
+            case 't':
+                options.threads = atoi(optarg);
+                break;
+            case 'i':
+                options.input = optarg;
+                break;
+            case 'C':
+                options.convert = optarg;
+                break;
+            case 'q':
+                options.quiet = 1;
+                break;
+            case 'B':
+                options.binary_dump = 1;
+                break;
+            case 'r':
+                options.strassen_cutoff = atoi(optarg);
+                break;
+            case 'p':
+                options.tile_pool = 1;
+                break;
+            case 'S':
+                options.sparse_density = atof(optarg);
+                break;
+            case 'T':
+                options.stats_file = optarg;
+                break;
+            case 'D':
+                options.daemon_socket = optarg;
+                break;
+            case 'c':
+                options.client_socket = optarg;
+                break;
+            default:
+                optind = argc; /* print usage */
+                break;
+        }
+    }
+
+    if (options.convert) {
+        return convert_matrices(options.input, options.convert) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (optind >= argc) {
+        printf("Usage: %s [-z | -p | -S density] [-q] [-B] [-t threads] [-r cutoff] [-T stats] [-i input] <process_count>\n", argv[0]);
+        printf("       %s [-i input] -C output\n", argv[0]);
+        printf("       %s [-t threads] [-r cutoff] -D socket <process_count>\n", argv[0]);
+        printf("       %s [-q] [-B] [-i input] -c socket <steps>\n", argv[0]);
+        printf("  -z  pass matrices through shared memory instead of copying them\n");
+        printf("  -p  processes work as a pool on tiles of every squaring, not as a chain\n");
+        printf("  -S  square and send matrices with a lower density (e.g. 0.05) as sparse\n");
+        printf("  -t  kernel threads of each process, 0 for all processors\n");
+        printf("  -r  use Strassen's algorithm for matrices bigger than cutoff (e.g. 128)\n");
+        printf("  -T  write timings of every process to a tab separated file, - for stderr\n");
+        printf("  -i  text or binary input with one or more matrices, - for stdin (default %s)\n", INPUT_FILE);
+        printf("  -C  convert text input to binary output or binary input to text output\n");
+        printf("  -D  keep the chain running and serve jobs on a Unix socket\n");
+        printf("  -c  send the input to the daemon, squaring every matrix <steps> times\n");
+        printf("  -q  quiet, do not print matrices to the console\n");
+        printf("  -B  dump results to binary $pnum.bin files instead of $pnum.txt\n");
         return EXIT_FAILURE;
     }
 
-    int pcount = atoi(argv[1]) + 1;
-    int** pipefd = create_pipefd(pcount);
+    if (options.sparse_density > 0 && (options.shared_memory || options.tile_pool)) {
+        fprintf(stderr, "Sparse mode works with the pipe transport of the chain only.\n");
+        return EXIT_FAILURE;
+    }
+    if (options.daemon_socket && (options.shared_memory || options.tile_pool || options.sparse_density > 0)) {
+        fprintf(stderr, "Daemon mode works with the pipe transport of the chain only.\n");
+        return EXIT_FAILURE;
+    }
+    if (options.daemon_socket && options.stats_file) {
+        fprintf(stderr, "Daemon mode runs until it is killed, so it has no timing summary.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* a finished process may close its pipes before its neighbours */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (options.client_socket) {
+        return service_client(&options, options.client_socket, atoi(argv[optind]));
+    }
+
+    pipeline_t pipeline;
+    pipeline.options = &options;
+    pipeline.pcount = atoi(argv[optind]) + 1;
+    pipeline.pipefd = create_pipefd(pipeline.pcount);
+    pipeline.ackfd = NULL;
+    pipeline.links = NULL;
+    pipeline.pool = NULL;
+    pipeline.arena.base = NULL;
+    pipeline.arena.size = 0;
+    pipeline.statsfd[0] = pipeline.statsfd[1] = -1;
+    if (options.stats_file && pipe(pipeline.statsfd)) {
+        fprintf(stderr, "Create pipe failed.\n");
+        return EXIT_FAILURE;
+    }
+    if (options.shared_memory && !options.tile_pool) {
+        pipeline.ackfd = create_pipefd(pipeline.pcount);
+        pipeline.links = create_shm_links(pipeline.pcount);
+    }
+    shm_slot_t slots[2]; /* matrix and its square in the tile pool mode */
+    if (options.tile_pool) {
+        create_shm_slot(&slots[0]);
+        create_shm_slot(&slots[1]);
+    }
 
     int i;
-    for (i = 1; i < pcount; ++i) {
+    for (i = 1; i < pipeline.pcount; ++i) {
         pid_t pid = fork();
         if (pid < (pid_t) 0) {
             fprintf(stderr, "Create child process(%d) failed.\n", i);
@@ -64,75 +175,314 @@ int main (int argc, char** argv) {
 
         /* Child process */
         if (pid == (pid_t) 0) {
-            child_work(pipefd, i, pcount);
+            if (pipeline.statsfd[0] >= 0) {
+                close(pipeline.statsfd[0]); /* children only write records */
+            }
+            if (options.daemon_socket) {
+                service_child_work(&pipeline, i);
+            } else if (options.tile_pool) {
+                tile_worker_work(&pipeline, slots, i);
+            } else {
+                child_work(&pipeline, i);
+            }
             return EXIT_SUCCESS;
         }
     }
 
     /* Main process */
-    main_work(pipefd, pcount);
-    return EXIT_SUCCESS;
+    int status = EXIT_SUCCESS;
+    if (options.daemon_socket) {
+        service_main(&pipeline, options.daemon_socket);
+    } else if (options.tile_pool) {
+        tile_main_work(&pipeline, slots);
+    } else {
+        status = main_work(&pipeline);
+    }
+    if (options.stats_file) {
+        close(pipeline.statsfd[1]); /* the summary ends when every process is done */
+        write_stats_summary(pipeline.statsfd[0], options.stats_file);
+        close(pipeline.statsfd[0]);
+    }
+    while (wait(NULL) > 0) {
+        /* wait for children to finish their output files */
+    }
+    return status;
 }
 
 /**
  * Main process work
- * Reads input matrix from the text file and writes it to the pipe.
- * Also reads result matrix of n-th process but nothing with that.
- * @param pipefd    pipe file descriptors
- * @param pcount    total process count
+ * Reads input matrices from the input file one by one and streams them to the
+ * pipe, so every process of the chain works on a different matrix at the
+ * same time. An empty matrix marks the end of the stream.
+ * Also reads result matrices of n-th process but nothing with them.
+ * @param pipeline  pipes and transport of the process chain
+ * @return EXIT_FAILURE if the input is truncated, EXIT_SUCCESS otherwise
  */
-void main_work(int** pipefd, int pcount) {
-    close_pipefd(pipefd, 0, pcount); /* close unnecessary pipes */
+int main_work(pipeline_t *pipeline) {
+    int pcount = pipeline->pcount;
+    close_pipefd(pipeline->pipefd, 0, pcount); /* close unnecessary pipes */
+    if (pipeline->ackfd) {
+        close_ackfd(pipeline->ackfd, 0, pcount);
+    }
+
+    /* results must be drained while the input is still being written */
+    pthread_t collector_thread;
+    pthread_create(&collector_thread, NULL, collector_routine, (void *) pipeline);
 
-    FILE* matrixFile = fopen(INPUT_FILE, "r"); /* open matrix.txt */
+    const char* input = pipeline->options->input;
+    matrix_reader_t* reader = open_matrix_reader(input); /* open matrix.txt */
+    if (reader == NULL) {
+        fprintf(stderr, "Cannot open %s.\n", input);
+        exit(EXIT_FAILURE);
+    }
+    stage_stats_t stats;
+    init_stats(&stats, 0);
+    double t = stats_clock();
+    int status = EXIT_SUCCESS;
     int n;
-    fscanf(matrixFile, "%d", &n); /* read square matrix size */
-    long long** matrix = scan_matrix(matrixFile, n); /* scan matrix */
-    fclose(matrixFile); /* close matrix.txt */
+    while ((n = next_matrix_size(reader)) > 0) { /* read square matrix size */
+        t = stats_lap(&stats, PHASE_RECEIVE, t);
+        long long* matrix = acquire_matrix(pipeline, 0, n); /* buffer of the first link */
+        t = stats_lap(&stats, PHASE_SEND, t);
+        if (!read_matrix_values(reader, matrix, n)) { /* scan matrix */
+            fprintf(stderr, "Matrix in %s is truncated.\n", input);
+            if (!pipeline->options->shared_memory) {
+                free(matrix); /* a slot of a link is simply not published */
+            }
+            status = EXIT_FAILURE; /* the matrices before it still go through the chain */
+            break;
+        }
+        t = stats_lap(&stats, PHASE_RECEIVE, t);
+        send_matrix(pipeline, 0, matrix, n); /* write matrix */
+        t = stats_lap(&stats, PHASE_SEND, t);
+        stats.matrices++;
+        stats.bytes_out += matrix_bytes(n);
+    }
+    close_matrix_reader(reader); /* close matrix.txt */
 
-    write(pipefd[0][1], &n, sizeof(n)); /* write matrix size */
-    write(pipefd[0][1], &matrix[0][0], sizeof(long long) * n * n); /* write matrix */
-    close(pipefd[0][1]); /* close write pipe */
+    send_end_of_stream(pipeline, 0);
+    close(pipeline->pipefd[0][1]); /* close write pipe */
+    report_stats(pipeline->statsfd[1], &stats);
 
-    read(pipefd[pcount - 1][0], &n, sizeof(n)); /* read square matrix size from last child process */
-    read(pipefd[pcount - 1][0], &matrix[0][0], sizeof(long long) * n * n); /* read matrix */
+    pthread_join(collector_thread, NULL);
+    close(pipeline->pipefd[pcount - 1][0]); /* close read pipe */
 
-    close(pipefd[pcount - 1][0]); /* close read pipe */
+    if (pipeline->links) {
+        destroy_shm_links(pipeline->links, pcount);
+        free_pipefd(pipeline->ackfd, pcount);
+    }
+    free_pipefd(pipeline->pipefd, pcount);
+    return status;
+}
 
-    free_2d_long(&matrix);
-    free_pipefd(pipefd, pcount);
+/**
+ * Subroutine for the collector thread of the main process.
+ * Reads result matrices of the last child process until the end of stream.
+ * @param args pointer of an pipeline_t
+ * @return NULL
+ */
+void* collector_routine(void* args) {
+    pipeline_t *pipeline = (pipeline_t *) args;
+    int link = pipeline->pcount - 1;
+
+    stage_stats_t stats;
+    init_stats(&stats, link + 1);
+
+    int n, slot;
+    long long* matrix;
+    double t = stats_clock();
+    while ((matrix = receive_matrix(pipeline, link, &n, &slot)) != NULL) { /* read matrix from last child process */
+        release_matrix(pipeline, link, matrix, slot);
+        t = stats_lap(&stats, PHASE_RECEIVE, t);
+        stats.matrices++;
+        stats.bytes_in += matrix_bytes(n);
+    }
+    report_stats(pipeline->statsfd[1], &stats);
+    return NULL;
 }
 
 /**
  * Child process work
- * Reads matrix from the previous process and calculate square of it. And
- * writes the result to the pipe for next process.
- * @param pipefd    pipe file descriptors
+ * Reads matrices from the previous process and calculates square of them.
+ * And writes the results to the pipe for next process, until the end of
+ * stream.
+ * @param pipeline  pipes and transport of the process chain
  * @param pnum      process number. 0(main process), 1, 2 and so on
- * @param pcount    total process count
  */
-void child_work(int** pipefd, int pnum, int pcount) {
-    close_pipefd(pipefd, pnum, pcount);
+void child_work(pipeline_t *pipeline, int pnum) {
+    int pcount = pipeline->pcount;
+    close_pipefd(pipeline->pipefd, pnum, pcount);
+    if (pipeline->ackfd) {
+        close_ackfd(pipeline->ackfd, pnum, pcount);
+    }
+    pipeline->pool = create_kernel_pool(pipeline->options->threads); /* threads do not survive fork */
 
-    int n;
-    long long** matrix;
+    if (pipeline->options->sparse_density > 0) {
+        sparse_child_work(pipeline, pnum);
+        return;
+    }
 
-    read(pipefd[pnum - 1][0], &n, sizeof(n)); /* read square matrix size */
-    malloc_2d_long(&matrix, n, n); /* allocate contiguous matrix */
-    read(pipefd[pnum-1][0], &matrix[0][0], sizeof(long long) * n * n); /* read matrix */
+    stage_stats_t stats;
+    init_stats(&stats, pnum);
+
+    int out = -1;
+    int n, slot;
+    long long* matrix;
+    double t = stats_clock();
+    while ((matrix = receive_matrix(pipeline, pnum - 1, &n, &slot)) != NULL) { /* read matrix */
+        t = stats_lap(&stats, PHASE_RECEIVE, t);
+        long long* result = acquire_matrix(pipeline, pnum, n); /* buffer of the next link */
+        t = stats_lap(&stats, PHASE_SEND, t);
+        square_matrix_mult(pipeline, matrix, result, n); /* calculate square of the matrix */
+        release_matrix(pipeline, pnum - 1, matrix, slot);
+        t = stats_lap(&stats, PHASE_COMPUTE, t);
+
+        if (out < 0) {
+            out = open_output(pipeline->options, pnum);
+        }
+        print_matrix(out, result, n, pnum, pipeline->options); /* print the matrix to output and a file */
+        t = stats_lap(&stats, PHASE_PRINT, t);
+        send_matrix(pipeline, pnum, result, n); /* write matrix */
+        t = stats_lap(&stats, PHASE_SEND, t);
+
+        stats.matrices++;
+        stats.bytes_in += matrix_bytes(n);
+        stats.bytes_out += matrix_bytes(n);
+        stats.multiply_adds += (double) n * n * n;
+    }
+    send_end_of_stream(pipeline, pnum);
+    report_stats(pipeline->statsfd[1], &stats);
+
+    if (out >= 0) {
+        close(out);
+    }
+    close(pipeline->pipefd[pnum - 1][0]); /* close read pipe */
+    close(pipeline->pipefd[pnum][1]); /* close write pipe */
+
+    destroy_kernel_pool(pipeline->pool);
+    free_arena(&pipeline->arena);
+    if (pipeline->links) {
+        destroy_shm_links(pipeline->links, pcount);
+        free_pipefd(pipeline->ackfd, pcount);
+    }
+    free_pipefd(pipeline->pipefd, pcount);
+}
+
+/**
+ * Child process work of the sparse mode
+ * Like child_work, but a matrix whose density is under the threshold is
+ * squared in the CSR format and sent to the next process as CSR. Once the
+ * fill-in passes the threshold, matrices go on as dense ones.
+ * @param pipeline  pipes and transport of the process chain
+ * @param pnum      process number. 0(main process), 1, 2 and so on
+ */
+void sparse_child_work(pipeline_t *pipeline, int pnum) {
+    int pcount = pipeline->pcount;
+    int read_end = pipeline->pipefd[pnum - 1][0];
+    int write_end = pipeline->pipefd[pnum][1];
+    double density = pipeline->options->sparse_density;
+
+    csr_matrix_t a, c;
+    csr_workspace_t workspace;
+    init_csr(&a);
+    init_csr(&c);
+    memset(&workspace, 0, sizeof(workspace));
+
+    stage_stats_t stats;
+    init_stats(&stats, pnum);
+
+    int out = -1;
+    matrix_frame_t frame;
+    double t = stats_clock();
+    while (read_full(read_end, &frame, sizeof(frame)) && frame.n > 0) { /* read matrix */
+        int n = frame.n;
+        double elements = (double) n * n;
+        if (out < 0) {
+            out = open_output(pipeline->options, pnum);
+        }
 
-    long long** result = square_matrix_mult(matrix, n); /* calculate square of the matrix */
-    print_matrix(result, n, pnum); /* print the matrix to output and a text file */
+        if (frame.format == FRAME_CSR) {
+            if (!read_csr(read_end, &frame, &a)) {
+                break;
+            }
+            t = stats_lap(&stats, PHASE_RECEIVE, t);
+            stats.matrices++;
+            stats.bytes_in += csr_bytes(&a);
+        } else {
+            long long* matrix = malloc_matrix(n);
+            if (!read_full(read_end, matrix, sizeof(long long) * n * n)) {
+                free(matrix);
+                break;
+            }
+            t = stats_lap(&stats, PHASE_RECEIVE, t);
+            stats.matrices++;
+            stats.bytes_in += matrix_bytes(n);
+            if (count_nonzeros(matrix, n) > density * elements) {
+                /* dense enough, same as child_work */
+                long long* result = malloc_matrix(n);
+                square_matrix_mult(pipeline, matrix, result, n);
+                free(matrix);
+                t = stats_lap(&stats, PHASE_COMPUTE, t);
+                print_matrix(out, result, n, pnum, pipeline->options);
+                t = stats_lap(&stats, PHASE_PRINT, t);
+                send_matrix(pipeline, pnum, result, n);
+                t = stats_lap(&stats, PHASE_SEND, t);
+                stats.bytes_out += matrix_bytes(n);
+                stats.multiply_adds += elements * n;
+                continue;
+            }
+            dense_to_csr(matrix, n, &a);
+            free(matrix);
+        }
 
-    close(pipefd[pnum - 1][0]); /* close read pipe */
+        stats.multiply_adds += csr_square(&a, &c, &workspace); /* calculate square of the matrix */
+        long long* result = malloc_matrix(n);
+        csr_to_dense(&c, result);
+        t = stats_lap(&stats, PHASE_COMPUTE, t);
+        print_matrix(out, result, n, pnum, pipeline->options); /* print the matrix to output and a file */
+        t = stats_lap(&stats, PHASE_PRINT, t);
+        if (c.nnz > density * elements) {
+            send_matrix(pipeline, pnum, result, n); /* filled in, go on dense */
+            stats.bytes_out += matrix_bytes(n);
+        } else {
+            write_csr(write_end, &c);
+            free(result);
+            stats.bytes_out += csr_bytes(&c);
+        }
+        t = stats_lap(&stats, PHASE_SEND, t);
+    }
+    send_end_of_stream(pipeline, pnum);
+    report_stats(pipeline->statsfd[1], &stats);
 
-    write(pipefd[pnum][1], &n, sizeof(n)); /* write matrix size */
-    write(pipefd[pnum][1], &result[0][0], sizeof(long long) * n * n); /* write matrix */
-    close(pipefd[pnum][1]); /* close write pipe */
+    if (out >= 0) {
+        close(out);
+    }
+    close(read_end); /* close read pipe */
+    close(write_end); /* close write pipe */
+
+    free_csr(&a);
+    free_csr(&c);
+    free_csr_workspace(&workspace);
+    destroy_kernel_pool(pipeline->pool);
+    free_arena(&pipeline->arena);
+    free_pipefd(pipeline->pipefd, pcount);
+}
 
-    free_2d_long(&matrix);
-    free_2d_long(&result);
-    free_pipefd(pipefd, pcount);
+/**
+ * Opens the output file of a process, "$pnum.txt" or "$pnum.bin"
+ * @param options   binary dump option
+ * @param pnum      process number
+ * @return file descriptor
+ */
+int open_output(const options_t* options, int pnum) {
+    char filename[16]; /* process number and extension(.txt or .bin) */
+    sprintf(filename, options->binary_dump ? "%d.bin" : "%d.txt", pnum);
+    int out = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        fprintf(stderr, "Cannot open %s.\n", filename);
+        exit(EXIT_FAILURE);
+    }
+    return out;
 }
 
 /**
@@ -171,6 +521,26 @@ void close_pipefd(int** pipefd, int pnum, int pcount) {
     }
 }
 
+/**
+ * Closes unnecessary acknowledgement pipe file descriptors. Link i is
+ * acknowledged by its reader and waited by its writer, process i.
+ * @param ackfd     acknowledgement pipe file descriptors
+ * @param pnum      process number. 0(main process), 1, 2 and so on
+ * @param pcount    total process count
+ * @see close_pipefd
+ */
+void close_ackfd(int** ackfd, int pnum, int pcount) {
+    int i;
+    for (i = 0; i < pcount; ++i) {
+        if (pnum != i) {
+            close(ackfd[i][0]);
+        }
+        if ((pnum == 0 && pcount - 1 != i) || (pnum != 0 && pnum != i + 1)) {
+            close(ackfd[i][1]);
+        }
+    }
+}
+
 /**
  * Deallocate pipefd
  * @param pipefd    pipe file descriptors
@@ -186,146 +556,269 @@ void free_pipefd(int** pipefd, int pcount) {
 }
 
 /**
- * Square matrix multiplication
- * Note: Used an n^3 complexity algorithm. There are better algorithms but
- * the objective of this experiment is to learn and apply process and pipe
- * basics.
- * @param matrix    2D long long array
+ * Returns a buffer for an n x n matrix that will be sent over the link.
+ * With shared memory it is a slot of the link itself, so the matrix is
+ * produced in place and never copied.
+ * @param pipeline  pipes and transport of the process chain
+ * @param link      link number, equals to the writer process number
  * @param n         matrix size
- * @return result matrix address
+ * @return the matrix address
  */
-long long** square_matrix_mult(long long** matrix, int n) {
-    long long** result;
-    malloc_2d_long(&result, n, n);
-
-    int i, j, k;
-    for (i = 0; i < n; ++i) {
-        for (j = 0; j < n; ++j) {
-            result[i][j] = 0;
-            for (k = 0; k < n; ++k) {
-                result[i][j] += matrix[i][k] * matrix[k][j];
-            }
-        }
+long long* acquire_matrix(pipeline_t *pipeline, int link, int n) {
+    if (pipeline->options->shared_memory) {
+        return shm_acquire(&pipeline->links[link], pipeline->ackfd[link][0], n);
     }
-
-    return result;
+    return malloc_matrix(n);
 }
 
 /**
- * Scans the matrix from a file descriptor
- * @param matrixFile    file descriptor
- * @param n             size of the matrix
- * @return the matrix address
+ * Sends a matrix taken by acquire_matrix to the next process. The matrix
+ * must not be used after that.
+ * @param pipeline  pipes and transport of the process chain
+ * @param link      link number, equals to the writer process number
+ * @param matrix    the matrix address
+ * @param n         matrix size
  */
-long long** scan_matrix(FILE* matrixFile, int n) {
-    long long** matrix;
-    malloc_2d_long(&matrix, n, n);
-
-    int i, j;
-    for (i = 0; i < n; ++i) {
-        for (j = 0; j < n; ++j) {
-            fscanf(matrixFile, "%lld,", &matrix[i][j]);
-        }
+void send_matrix(pipeline_t *pipeline, int link, long long* matrix, int n) {
+    if (pipeline->options->shared_memory) {
+        shm_publish(&pipeline->links[link], pipeline->pipefd[link][1], n);
+        return;
     }
-
-    return matrix;
+    matrix_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.n = n;
+    frame.format = FRAME_DENSE;
+
+    struct iovec iov[2];
+    iov[0].iov_base = &frame; /* matrix size */
+    iov[0].iov_len = sizeof(frame);
+    iov[1].iov_base = matrix;
+    iov[1].iov_len = sizeof(long long) * n * n;
+    writev_full(pipeline->pipefd[link][1], iov, 2); /* write matrix */
+    free(matrix);
 }
 
 /**
- * Prints the square matrix to the console and a text file named "$pnum.txt"
- * @param matrix    the matrix address
- * @param n         size of the matrix
- * @param pnum      process number
+ * Tells the next process that no more matrices will come.
+ * @param pipeline  pipes and transport of the process chain
+ * @param link      link number, equals to the writer process number
  */
-void print_matrix(long long** matrix, int n, int pnum) {
-    int max_length = max_length_in_matrix(matrix, n);
-    char filename[7]; /* max 2 digit(10) for filename and 4 for extension(.txt) */
-    sprintf(filename, "%d.txt", pnum);
-    FILE* out = fopen(filename, "w");
+void send_end_of_stream(pipeline_t *pipeline, int link) {
+    if (pipeline->options->shared_memory) {
+        shm_message_t message;
+        message.n = 0;
+        message.slot = 0;
+        write_full(pipeline->pipefd[link][1], &message, sizeof(message));
+        return;
+    }
+    matrix_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    write_full(pipeline->pipefd[link][1], &frame, sizeof(frame));
+}
 
-    printf("Process-%d %d\n\n", pnum, getpid());
-    fprintf(out, "Process-%d %d\n", pnum, getpid());
+/**
+ * Receives a matrix from the previous process.
+ * @param pipeline  pipes and transport of the process chain
+ * @param link      link number, equals to the writer process number
+ * @param n         destination of the matrix size
+ * @param slot      destination of the transport slot, see release_matrix
+ * @return the matrix address, NULL if the writer has nothing to send
+ */
+long long* receive_matrix(pipeline_t *pipeline, int link, int* n, int* slot) {
+    if (pipeline->options->shared_memory) {
+        return shm_receive(&pipeline->links[link], pipeline->pipefd[link][0], n, slot);
+    }
 
-    int i, j;
-    for (i = 0; i < n; ++i) {
-        for (j = 0; j < n; ++j) {
-            printf("%-*lld", max_length, matrix[i][j]);
-            fprintf(out, "%-*lld", max_length, matrix[i][j]);
+    *slot = 0;
+    matrix_frame_t frame;
+    if (!read_full(pipeline->pipefd[link][0], &frame, sizeof(frame)) || frame.n <= 0) { /* read square matrix size */
+        return NULL;
+    }
+    *n = frame.n;
+    long long* matrix = malloc_matrix(*n);
+
+    if (frame.format == FRAME_CSR) { /* sparse stages may send CSR matrices */
+        csr_matrix_t csr;
+        init_csr(&csr);
+        int ok = read_csr(pipeline->pipefd[link][0], &frame, &csr);
+        if (ok) {
+            csr_to_dense(&csr, matrix);
+        }
+        free_csr(&csr);
+        if (ok) {
+            return matrix;
         }
-        printf("\n");
-        fprintf(out, "\n");
+    } else if (read_full(pipeline->pipefd[link][0], matrix, sizeof(long long) * *n * *n)) { /* read matrix */
+        return matrix;
     }
-    printf("\n");
-
-    fclose(out);
+    free(matrix);
+    return NULL;
 }
 
 /**
- * Returns the maximum number length in a matrix
+ * Releases a matrix returned by receive_matrix.
+ * @param pipeline  pipes and transport of the process chain
+ * @param link      link number, equals to the writer process number
  * @param matrix    the matrix address
- * @param n         size of the matrix
- * @return the maximum number length
+ * @param slot      transport slot of the matrix
  */
-int max_length_in_matrix(long long** matrix, int n) {
-    long long max = 0;
-
-    int i, j;
-    for (i = 0; i < n; ++i) {
-        for (j = 0; j < n; ++j) {
-            if (matrix[i][j] > max) {
-                max = matrix[i][j];
-            } else if (-matrix[i][j] > max) {
-                max = -matrix[i][j];
-            }
-        }
+void release_matrix(pipeline_t *pipeline, int link, long long* matrix, int slot) {
+    if (pipeline->options->shared_memory) {
+        shm_release(pipeline->ackfd[link][1], slot);
+        return;
     }
-    return digit_count(max) + 2; /* 1 for minus sign and 1 for space */
+    free(matrix);
 }
 
 /**
- * Digit count of a number
- * @param number a long long number
- * @return digit count of the number
+ * Square matrix multiplication
+ * Note: An n^3 complexity algorithm, but cache-blocked and shared by the
+ * threads of the pool. Strassen's algorithm is used on top of it if it is
+ * enabled. Please see kernel.c
+ * @param pipeline  kernel threads, workspace and options of this process
+ * @param matrix    contiguous long long matrix
+ * @param result    destination matrix, must not overlap the matrix
+ * @param n         matrix size
  */
-int digit_count(long long number) {
-    char snum[100];
-    return sprintf(snum, "%lld", number);
+void square_matrix_mult(pipeline_t *pipeline, const long long* matrix, long long* result, int n) {
+    int cutoff = pipeline->options->strassen_cutoff;
+    if (cutoff > 0 && n > cutoff) {
+        reserve_arena(&pipeline->arena, strassen_workspace_size(n, cutoff));
+        strassen_matrix_mult(pipeline->pool, n, matrix, n, matrix, n, result, n, cutoff, pipeline->arena.base);
+        return;
+    }
+    pool_matrix_mult(pipeline->pool, n, n, n, matrix, n, matrix, n, result, n, 0);
 }
 
 /**
- * Contiguous 2D long long array allocation using malloc.
- * @param array destination 2d array pointer
- * @param m     row count
- * @param n     column count
+ * Prints the square matrix to the console and a text file named "$pnum.txt"
+ * or dumps it to a binary file named "$pnum.bin".
+ * Every element is formatted once, in the same pass that finds the column
+ * width, and the padded rows are copied into a block buffer that is
+ * written to both of them with writev.
+ * @param out       opened "$pnum.txt" or "$pnum.bin"
+ * @param matrix    the matrix address
+ * @param n         size of the matrix
+ * @param pnum      process number
+ * @param options   binary dump and quiet options
  */
-void malloc_2d_long(long long*** array, int m, int n) {
+void print_matrix(int out, const long long* matrix, int n, int pnum, const options_t* options) {
+    int text_file = !options->binary_dump;
+    int console = !options->quiet;
+    if (options->binary_dump) {
+        write_matrix_binary(out, matrix, n);
+    }
+    if (!text_file && !console) {
+        return;
+    }
 
-    /* allocate m * n contiguous long long */
-    long long* p = (long long*) malloc(m * n * sizeof(long long));
-    if (!p) {
+    /* the width is known after the last element, so the numbers are kept
+     * unpadded until then */
+    size_t k, count = (size_t) n * n;
+    size_t capacity = count * 12 + PRINT_NUMBER;
+    char* numbers = (char*) malloc(capacity);
+    unsigned char* lengths = (unsigned char*) malloc(count);
+    if (!numbers || !lengths) {
         exit(EXIT_FAILURE);
     }
+    size_t used = 0;
+    int max_digits = 1;
+    for (k = 0; k < count; ++k) {
+        if (capacity - used < PRINT_NUMBER) {
+            capacity *= 2;
+            numbers = (char*) realloc(numbers, capacity);
+            if (!numbers) {
+                exit(EXIT_FAILURE);
+            }
+        }
+        int length = format_long_long(numbers + used, matrix[k]);
+        int digits = length - (matrix[k] < 0);
+        max_digits = digits > max_digits ? digits : max_digits;
+        lengths[k] = (unsigned char) length;
+        used += (size_t) length;
+    }
+    int max_length = max_digits + 2; /* 1 for minus sign and 1 for space */
 
-    /* allocate rows */
-    *array = (long long**) malloc(m * sizeof(long long*));
-    if (!(*array)) {
-        free(p);
+    size_t row_size = (size_t) max_length * n + 1;
+    int block_rows = (int) (PRINT_BLOCK / row_size);
+    block_rows = block_rows < 1 ? 1 : (block_rows > n ? n : block_rows);
+    char* block = (char*) malloc(row_size * block_rows);
+    if (!block) {
         exit(EXIT_FAILURE);
     }
 
-    int i;
-    for (i = 0; i < m; ++i) {
-        (*array)[i] = &(p[i * n]);
+    char console_header[64], file_header[64];
+    int console_header_length = sprintf(console_header, "Process-%d %d\n\n", pnum, getpid());
+    int file_header_length = sprintf(file_header, "Process-%d %d\n", pnum, getpid());
+    char newline[] = "\n";
+
+    const char* number = numbers;
+    int i, j;
+    k = 0;
+    for (i = 0; i < n; i += block_rows) {
+        int last = i + block_rows < n ? i + block_rows : n;
+        char* p = block;
+        int r;
+        for (r = i; r < last; ++r) {
+            for (j = 0; j < n; ++j, ++k) {
+                memcpy(p, number, lengths[k]);
+                memset(p + lengths[k], ' ', max_length - lengths[k]); /* left justified like "%-*lld" */
+                number += lengths[k];
+                p += max_length;
+            }
+            *p++ = '\n';
+        }
+
+        struct iovec iov[3];
+        int count = 0;
+        if (text_file) {
+            if (i == 0) {
+                iov[count].iov_base = file_header;
+                iov[count++].iov_len = file_header_length;
+            }
+            iov[count].iov_base = block;
+            iov[count++].iov_len = p - block;
+            writev_full(out, iov, count);
+        }
+        if (console) {
+            count = 0;
+            if (i == 0) {
+                iov[count].iov_base = console_header;
+                iov[count++].iov_len = console_header_length;
+            }
+            iov[count].iov_base = block;
+            iov[count++].iov_len = p - block;
+            if (last == n) {
+                iov[count].iov_base = newline;
+                iov[count++].iov_len = 1;
+            }
+            writev_full(STDOUT_FILENO, iov, count);
+        }
     }
+
+    free(block);
+    free(lengths);
+    free(numbers);
 }
 
+/**
+ * Size of a dense n x n matrix
+ * @param n     matrix size
+ * @return byte count
+ */
+long long matrix_bytes(int n) {
+    return (long long) sizeof(long long) * n * n;
+}
 
 /**
- * Deallocate contiguous 2D long long array
- * @param array destination 2d array pointer
- * @see malloc_2d_long long
+ * Contiguous n x n long long matrix allocation using malloc.
+ * @param n     matrix size
+ * @return the matrix address
  */
-void free_2d_long(long long*** array) {
-    free(&((*array)[0][0]));
-    free(*array);
+long long* malloc_matrix(int n) {
+    long long* p = (long long*) malloc(sizeof(long long) * n * n);
+    if (!p) {
+        exit(EXIT_FAILURE);
+    }
+    return p;
 }
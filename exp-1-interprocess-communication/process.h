@@ -0,0 +1,65 @@
+#ifndef BBM342_EXP1_PROCESS_H
+#define BBM342_EXP1_PROCESS_H
+
+#include <stdio.h>
+
+#include "kernel.h"
+#include "matrix_io.h"
+#include "sparse.h"
+#include "stats.h"
+#include "transport.h"
+
+typedef struct options {
+    int shared_memory; /* pass matrices through memfd buffers, not pipes */
+    int threads;       /* kernel threads per process, 0 for all processors */
+    const char *input; /* matrix stream, "-" for stdin */
+    const char *convert; /* convert the input to this file and exit */
+    int quiet;         /* do not echo matrices to the console */
+    int binary_dump;   /* write $pnum.bin instead of $pnum.txt */
+    int strassen_cutoff; /* Strassen above this size, 0 to disable */
+    int tile_pool;     /* processes share tiles of every squaring */
+    double sparse_density; /* CSR under this density, 0 to disable */
+    const char *stats_file; /* timing summary of every process */
+    const char *daemon_socket; /* serve jobs on this socket with a warm chain */
+    const char *client_socket; /* send jobs to the daemon on this socket */
+} options_t;
+
+typedef struct pipeline {
+    int** pipefd;       /* pipefd[i] carries matrices from process i to i+1 */
+    int** ackfd;        /* ackfd[i] gives slots of link i back, shared memory only */
+    shm_link_t *links;  /* shared memory only */
+    int pcount;
+    kernel_pool_t *pool; /* created by each process after fork */
+    kernel_arena_t arena; /* workspace of Strassen's algorithm */
+    int statsfd[2];     /* side channel of stage_stats_t records, -1 if disabled */
+    const options_t *options;
+} pipeline_t;
+
+/* Process works */
+int main_work(pipeline_t *pipeline);
+void child_work(pipeline_t *pipeline, int pnum);
+void sparse_child_work(pipeline_t *pipeline, int pnum);
+void* collector_routine(void* args);
+int open_output(const options_t* options, int pnum);
+
+/* Pipe operations */
+int** create_pipefd(int pcount);
+void close_pipefd(int** pipefd, int pnum, int pcount);
+void close_ackfd(int** ackfd, int pnum, int pcount);
+void free_pipefd(int** pipefd, int pcount);
+
+/* Matrix transport over pipes or shared memory */
+long long* acquire_matrix(pipeline_t *pipeline, int link, int n);
+void send_matrix(pipeline_t *pipeline, int link, long long* matrix, int n);
+void send_end_of_stream(pipeline_t *pipeline, int link);
+long long* receive_matrix(pipeline_t *pipeline, int link, int* n, int* slot);
+void release_matrix(pipeline_t *pipeline, int link, long long* matrix, int slot);
+
+/* Matrix operations */
+void square_matrix_mult(pipeline_t *pipeline, const long long* matrix, long long* result, int n);
+void print_matrix(int out, const long long* matrix, int n, int pnum, const options_t* options);
+
+long long matrix_bytes(int n);
+long long* malloc_matrix(int n);
+
+#endif
@@ -0,0 +1,483 @@
+/**
+ * BBM 342 Operating Systems
+ * Experiment 1
+ * Matrix squaring service over a Unix domain socket
+ *
+ * The daemon forks the chain once and keeps its processes warm. Clients
+ * connect to the socket and send any number of jobs, a service_header_t
+ * with the matrix size and the squaring count followed by the matrix. Every
+ * job travels the whole chain: the first `steps` processes square it and
+ * the rest pass it on. So jobs come out of the last pipe in the order they
+ * went in. A single collector thread queues every result for its client,
+ * and a writer thread of the client sends them back as a service_header_t
+ * and the matrix, so a client that does not read its replies holds up only
+ * its own jobs. A client ends its jobs by shutting down its side of the
+ * socket; the daemon closes the connection after the last reply. A client
+ * with a matrix bigger than SERVICE_MAX_N, or one that cannot be allocated,
+ * is refused by shutting down its connection.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "service.h"
+
+#define ACCEPT_BACKOFF  100000  /* microseconds to wait while out of descriptors */
+
+/* Arguments of the request sender of a client */
+typedef struct client_sender {
+    int fd;
+    int steps;
+    const options_t *options;
+} client_sender_t;
+
+static int open_socket(const char *path, struct sockaddr_un *address);
+static void* reader_routine(void* args);
+static void* service_collector_routine(void* args);
+static void* writer_routine(void* args);
+static void* sender_routine(void* args);
+static void end_requests(service_client_t *client);
+static int discard_bytes(int fd, long long size);
+
+/**
+ * Daemon work of the main process. Accepts clients until the process is
+ * killed or accept fails for good; the children see the end of their pipes
+ * and exit then. While descriptors or memory run out, accept is retried
+ * after a while, as clients that finish free them.
+ * @param pipeline  pipes and options of the warm chain
+ * @param path      socket path
+ */
+void service_main(pipeline_t *pipeline, const char *path) {
+    int pcount = pipeline->pcount;
+    close_pipefd(pipeline->pipefd, 0, pcount);
+
+    service_t service;
+    memset(&service, 0, sizeof(service));
+    service.pipeline = pipeline;
+    pthread_mutex_init(&service.lock, NULL);
+    pthread_mutex_init(&service.chain_lock, NULL);
+    int i;
+    for (i = 0; i < MAX_CLIENTS; ++i) {
+        service.clients[i].service = &service;
+        service.clients[i].fd = -1;
+        pthread_cond_init(&service.clients[i].changed, NULL);
+    }
+
+    struct sockaddr_un address;
+    int listener = open_socket(path, &address);
+    unlink(path); /* left by an earlier daemon */
+    if (bind(listener, (struct sockaddr *) &address, sizeof(address)) || listen(listener, MAX_CLIENTS)) {
+        fprintf(stderr, "Cannot listen on %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_t collector_thread;
+    pthread_create(&collector_thread, NULL, service_collector_routine, (void *) &service);
+
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                usleep(ACCEPT_BACKOFF);
+                continue;
+            }
+            exit(EXIT_FAILURE);
+        }
+
+        service_client_t *client = NULL;
+        pthread_mutex_lock(&service.lock);
+        for (i = 0; i < MAX_CLIENTS && client == NULL; ++i) {
+            if (!service.clients[i].used) {
+                client = &service.clients[i];
+                client->used = 1;
+                client->reading = 1;
+                client->pending = 0;
+                client->head = client->tail = NULL;
+                client->queued = 0;
+                client->fd = fd;
+            }
+        }
+        pthread_mutex_unlock(&service.lock);
+
+        pthread_t reader_thread, writer_thread;
+        if (client == NULL) {
+            close(fd); /* too many clients */
+        } else if (pthread_create(&writer_thread, NULL, writer_routine, (void *) client)) {
+            pthread_mutex_lock(&service.lock);
+            close(fd);
+            client->fd = -1;
+            client->used = 0;
+            pthread_mutex_unlock(&service.lock);
+        } else {
+            pthread_detach(writer_thread);
+            if (pthread_create(&reader_thread, NULL, reader_routine, (void *) client)) {
+                end_requests(client); /* the writer closes the connection */
+            } else {
+                pthread_detach(reader_thread);
+            }
+        }
+    }
+}
+
+/**
+ * Child process work of the daemon mode
+ * Squares the jobs that still have steps for this process and passes the
+ * others on, until the daemon is gone.
+ * @param pipeline  pipes and options of the warm chain
+ * @param pnum      process number. 1, 2 and so on
+ */
+void service_child_work(pipeline_t *pipeline, int pnum) {
+    int pcount = pipeline->pcount;
+    close_pipefd(pipeline->pipefd, pnum, pcount);
+    pipeline->pool = create_kernel_pool(pipeline->options->threads); /* threads do not survive fork */
+    int read_end = pipeline->pipefd[pnum - 1][0];
+    int write_end = pipeline->pipefd[pnum][1];
+
+    service_job_t job;
+    while (read_full(read_end, &job, sizeof(job)) && job.n > 0) {
+        int n = job.n;
+        long long* matrix = malloc_matrix(n);
+        if (!read_full(read_end, matrix, matrix_bytes(n))) {
+            free(matrix);
+            break;
+        }
+        if (job.steps >= pnum) {
+            long long* result = malloc_matrix(n);
+            square_matrix_mult(pipeline, matrix, result, n); /* calculate square of the matrix */
+            free(matrix);
+            matrix = result;
+        }
+
+        struct iovec iov[2];
+        iov[0].iov_base = &job;
+        iov[0].iov_len = sizeof(job);
+        iov[1].iov_base = matrix;
+        iov[1].iov_len = matrix_bytes(n);
+        writev_full(write_end, iov, 2);
+        free(matrix);
+    }
+
+    close(read_end);
+    close(write_end);
+    destroy_kernel_pool(pipeline->pool);
+    free_arena(&pipeline->arena);
+    free_pipefd(pipeline->pipefd, pcount);
+}
+
+/**
+ * Client mode. Sends every matrix of the input as a job and prints the
+ * results like process `steps` of the chain does.
+ * @param options   input, quiet and binary dump options
+ * @param path      socket path of the daemon
+ * @param steps     squaring count of every matrix
+ * @return status value as integer
+ */
+int service_client(const options_t *options, const char *path, int steps) {
+    struct sockaddr_un address;
+    int fd = open_socket(path, &address);
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address))) {
+        fprintf(stderr, "Cannot connect to %s.\n", path);
+        return EXIT_FAILURE;
+    }
+
+    /* replies must be read while the jobs are still being written */
+    client_sender_t sender;
+    sender.fd = fd;
+    sender.steps = steps;
+    sender.options = options;
+    pthread_t sender_thread;
+    pthread_create(&sender_thread, NULL, sender_routine, (void *) &sender);
+
+    int out = -1;
+    service_header_t reply;
+    while (read_full(fd, &reply, sizeof(reply)) && reply.n > 0) {
+        long long* matrix = malloc_matrix(reply.n);
+        if (!read_full(fd, matrix, matrix_bytes(reply.n))) {
+            free(matrix);
+            break;
+        }
+        if (out < 0) {
+            out = open_output(options, reply.steps);
+        }
+        print_matrix(out, matrix, reply.n, reply.steps, options);
+        free(matrix);
+    }
+
+    pthread_join(sender_thread, NULL);
+    if (out >= 0) {
+        close(out);
+    }
+    close(fd);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Creates a Unix domain socket and its address
+ * @param path      socket path
+ * @param address   filled with the path
+ * @return socket file descriptor
+ */
+static int open_socket(const char *path, struct sockaddr_un *address) {
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path %s is too long.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Create socket failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+/**
+ * Subroutine of the reader thread of a client.
+ * Reads jobs of the client and writes them to the first pipe of the chain.
+ * A job with an invalid size or step count ends the requests; a matrix
+ * bigger than SERVICE_MAX_N, or one that cannot be allocated, refuses the
+ * client. While too many of its replies are queued, its next job waits.
+ * @param args pointer of an service_client_t
+ * @return NULL
+ */
+static void* reader_routine(void* args) {
+    service_client_t *client = (service_client_t *) args;
+    service_t *service = client->service;
+    pipeline_t *pipeline = service->pipeline;
+
+    service_header_t request;
+    while (read_full(client->fd, &request, sizeof(request)) && request.n > 0 &&
+           request.steps > 0 && request.steps < pipeline->pcount) {
+        service_job_t job;
+        memset(&job, 0, sizeof(job));
+        job.n = request.n;
+        job.steps = request.steps;
+        job.client = (int) (client - service->clients);
+
+        long long* matrix = NULL;
+        if (job.n <= SERVICE_MAX_N) {
+            matrix = (long long*) malloc((size_t) matrix_bytes(job.n));
+        }
+        if (matrix == NULL) {
+            shutdown(client->fd, SHUT_RDWR); /* refused, the daemon goes on */
+            break;
+        }
+        if (!read_full(client->fd, matrix, matrix_bytes(job.n))) {
+            free(matrix);
+            break;
+        }
+
+        pthread_mutex_lock(&service->lock);
+        while (client->queued >= CLIENT_QUEUE) {
+            pthread_cond_wait(&client->changed, &service->lock); /* the client is not reading */
+        }
+        client->pending++; /* before the collector can see the job */
+        pthread_mutex_unlock(&service->lock);
+
+        struct iovec iov[2];
+        iov[0].iov_base = &job;
+        iov[0].iov_len = sizeof(job);
+        iov[1].iov_base = matrix;
+        iov[1].iov_len = matrix_bytes(job.n);
+        pthread_mutex_lock(&service->chain_lock);
+        writev_full(pipeline->pipefd[0][1], iov, 2);
+        pthread_mutex_unlock(&service->chain_lock);
+        free(matrix);
+    }
+    end_requests(client);
+    return NULL;
+}
+
+/**
+ * Subroutine for the collector thread of the daemon.
+ * Reads results from the last child process and queues them for their
+ * clients. It never writes to a client, so the chain does not wait for one.
+ * A result that cannot be allocated is dropped and its client refused.
+ * @param args pointer of an service_t
+ * @return NULL
+ */
+static void* service_collector_routine(void* args) {
+    service_t *service = (service_t *) args;
+    pipeline_t *pipeline = service->pipeline;
+    int read_end = pipeline->pipefd[pipeline->pcount - 1][0];
+
+    service_job_t job;
+    while (read_full(read_end, &job, sizeof(job)) && job.n > 0) {
+        service_client_t *client = &service->clients[job.client];
+        service_reply_t *reply = (service_reply_t *) malloc(sizeof(service_reply_t));
+        long long* matrix = (long long*) malloc((size_t) matrix_bytes(job.n));
+        if (reply == NULL || matrix == NULL) {
+            free(reply);
+            free(matrix);
+            if (!discard_bytes(read_end, matrix_bytes(job.n))) {
+                break;
+            }
+            pthread_mutex_lock(&service->lock);
+            shutdown(client->fd, SHUT_RDWR);
+            client->pending--;
+            pthread_cond_broadcast(&client->changed);
+            pthread_mutex_unlock(&service->lock);
+            continue;
+        }
+        if (!read_full(read_end, matrix, matrix_bytes(job.n))) {
+            free(reply);
+            free(matrix);
+            break;
+        }
+
+        reply->next = NULL;
+        reply->header.n = job.n;
+        reply->header.steps = job.steps;
+        reply->matrix = matrix;
+        pthread_mutex_lock(&service->lock);
+        if (client->tail) {
+            client->tail->next = reply;
+        } else {
+            client->head = reply;
+        }
+        client->tail = reply;
+        client->queued += matrix_bytes(job.n);
+        pthread_cond_broadcast(&client->changed);
+        pthread_mutex_unlock(&service->lock);
+    }
+    return NULL;
+}
+
+/**
+ * Subroutine of the writer thread of a client.
+ * Sends the queued replies of the client and closes its connection once its
+ * requests are read and all of its jobs are answered.
+ * @param args pointer of an service_client_t
+ * @return NULL
+ */
+static void* writer_routine(void* args) {
+    service_client_t *client = (service_client_t *) args;
+    service_t *service = client->service;
+    int failed = 0;
+
+    pthread_mutex_lock(&service->lock);
+    for (;;) {
+        while (client->head == NULL && (client->reading > 0 || client->pending > 0)) {
+            pthread_cond_wait(&client->changed, &service->lock);
+        }
+        service_reply_t *reply = client->head;
+        if (reply == NULL) {
+            break;
+        }
+        client->head = reply->next;
+        if (client->head == NULL) {
+            client->tail = NULL;
+        }
+        pthread_mutex_unlock(&service->lock);
+
+        long long bytes = matrix_bytes(reply->header.n);
+        if (!failed) {
+            struct iovec iov[2];
+            iov[0].iov_base = &reply->header;
+            iov[0].iov_len = sizeof(reply->header);
+            iov[1].iov_base = reply->matrix;
+            iov[1].iov_len = bytes;
+            failed = !writev_full(client->fd, iov, 2); /* a client that is gone gets no more replies */
+        }
+        free(reply->matrix);
+        free(reply);
+
+        pthread_mutex_lock(&service->lock);
+        client->queued -= bytes;
+        client->pending--;
+        pthread_cond_broadcast(&client->changed);
+    }
+    close(client->fd);
+    client->fd = -1;
+    client->used = 0;
+    pthread_mutex_unlock(&service->lock);
+    return NULL;
+}
+
+/**
+ * Subroutine of the request sender of the client mode.
+ * Sends every matrix of the input and shuts down the write side.
+ * @param args pointer of an client_sender_t
+ * @return NULL
+ */
+static void* sender_routine(void* args) {
+    client_sender_t *sender = (client_sender_t *) args;
+    const char* input = sender->options->input;
+    matrix_reader_t* reader = open_matrix_reader(input);
+    if (reader == NULL) {
+        fprintf(stderr, "Cannot open %s.\n", input);
+        exit(EXIT_FAILURE);
+    }
+
+    service_header_t request;
+    request.steps = sender->steps;
+    while ((request.n = next_matrix_size(reader)) > 0) {
+        long long* matrix = malloc_matrix(request.n);
+        if (!read_matrix_values(reader, matrix, request.n)) {
+            fprintf(stderr, "Matrix in %s is truncated.\n", input);
+            free(matrix);
+            break;
+        }
+        struct iovec iov[2];
+        iov[0].iov_base = &request;
+        iov[0].iov_len = sizeof(request);
+        iov[1].iov_base = matrix;
+        iov[1].iov_len = matrix_bytes(request.n);
+        int sent = writev_full(sender->fd, iov, 2);
+        free(matrix);
+        if (!sent) {
+            break;
+        }
+    }
+    close_matrix_reader(reader);
+    shutdown(sender->fd, SHUT_WR); /* no more jobs */
+    return NULL;
+}
+
+/**
+ * Marks the requests of a client as done, so its writer closes the
+ * connection after the last reply.
+ * @param client    pointer of an service_client_t
+ */
+static void end_requests(service_client_t *client) {
+    service_t *service = client->service;
+    pthread_mutex_lock(&service->lock);
+    client->reading = 0;
+    pthread_cond_broadcast(&client->changed);
+    pthread_mutex_unlock(&service->lock);
+}
+
+/**
+ * Reads and drops bytes of a pipe
+ * @param fd    file descriptor
+ * @param size  byte count
+ * @return 1 on success, 0 on error or end of file
+ */
+static int discard_bytes(int fd, long long size) {
+    char buffer[1 << 16];
+    while (size > 0) {
+        size_t chunk = size < (long long) sizeof(buffer) ? (size_t) size : sizeof(buffer);
+        if (!read_full(fd, buffer, chunk)) {
+            return 0;
+        }
+        size -= (long long) chunk;
+    }
+    return 1;
+}
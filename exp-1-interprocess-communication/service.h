@@ -0,0 +1,56 @@
+#ifndef BBM342_EXP1_SERVICE_H
+#define BBM342_EXP1_SERVICE_H
+
+#include "process.h"
+
+#define MAX_CLIENTS     64
+#define SERVICE_MAX_N   4096            /* clients with bigger matrices are refused */
+#define CLIENT_QUEUE    (64LL << 20)    /* reply bytes queued before a client's jobs wait */
+
+/* Request from a client and reply of the service, followed by n * n elements */
+typedef struct service_header {
+    int n;      /* 0 ends the requests of a client */
+    int steps;  /* squarings, 1 to the chain length */
+} service_header_t;
+
+/* Job header on the pipes of the warm chain, followed by n * n elements */
+typedef struct service_job {
+    int n;      /* 0 marks the end of stream */
+    int steps;
+    int client; /* slot of the client that gets the result */
+    int reserved;
+} service_job_t;
+
+/* Result waiting to be sent to its client */
+typedef struct service_reply {
+    struct service_reply *next;
+    service_header_t header;
+    long long *matrix;
+} service_reply_t;
+
+/* Connection of a client */
+typedef struct service_client {
+    struct service *service;
+    int fd;
+    int used;
+    int reading;  /* its requests are still being read */
+    int pending;  /* jobs in the chain or in the queue */
+    service_reply_t *head;  /* replies not sent yet */
+    service_reply_t *tail;
+    long long queued;       /* bytes of the queued replies */
+    pthread_cond_t changed; /* a reply is queued or sent, or the requests end */
+} service_client_t;
+
+/* Daemon state shared by the accept loop, the readers and the collector */
+typedef struct service {
+    pipeline_t *pipeline;
+    pthread_mutex_t lock;       /* client slots and their queues */
+    pthread_mutex_t chain_lock; /* writes to the first pipe */
+    service_client_t clients[MAX_CLIENTS];
+} service_t;
+
+void service_main(pipeline_t *pipeline, const char *path);
+void service_child_work(pipeline_t *pipeline, int pnum);
+int service_client(const options_t *options, const char *path, int steps);
+
+#endif
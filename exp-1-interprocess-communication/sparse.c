@@ -0,0 +1,255 @@
+/**
+ * BBM 342 Operating Systems
+ * Experiment 1
+ * Sparse (CSR) matrices
+ *
+ * Mostly-zero matrices are squared row by row with Gustavson's algorithm:
+ * the rows of A selected by the nonzeros of a row are accumulated into a
+ * dense row with a marker array, so the cost depends on the nonzeros and
+ * not on n^3. On a pipe, a CSR matrix is a matrix_frame_t followed by the
+ * row offsets, the column indices and the values. Arithmetic is modulo 2^64
+ * like the dense kernels, so results are identical.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "sparse.h"
+#include "transport.h"
+
+/**
+ * Initializes an empty CSR matrix
+ * @param csr pointer of an csr_matrix_t
+ */
+void init_csr(csr_matrix_t *csr) {
+    memset(csr, 0, sizeof(csr_matrix_t));
+}
+
+/**
+ * Makes sure that a CSR matrix has room for an n x n matrix with capacity
+ * nonzeros. Existing elements are kept.
+ * @param csr       pointer of an csr_matrix_t
+ * @param n         matrix size
+ * @param capacity  nonzero count
+ */
+void reserve_csr(csr_matrix_t *csr, int n, size_t capacity) {
+    if (n > csr->n || csr->row_ptr == NULL) {
+        csr->row_ptr = (long long *) realloc(csr->row_ptr, sizeof(long long) * (n + 1));
+        if (!csr->row_ptr) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    csr->n = n;
+    if (capacity > csr->capacity) {
+        csr->columns = (int *) realloc(csr->columns, sizeof(int) * capacity);
+        csr->values = (long long *) realloc(csr->values, sizeof(long long) * capacity);
+        if (!csr->columns || !csr->values) {
+            exit(EXIT_FAILURE);
+        }
+        csr->capacity = capacity;
+    }
+}
+
+/**
+ * Deallocates arrays of a CSR matrix
+ * @param csr pointer of an csr_matrix_t
+ */
+void free_csr(csr_matrix_t *csr) {
+    free(csr->row_ptr);
+    free(csr->columns);
+    free(csr->values);
+    init_csr(csr);
+}
+
+/**
+ * Counts nonzero elements of a dense matrix
+ * @param matrix    contiguous matrix
+ * @param n         matrix size
+ * @return nonzero count
+ */
+long long count_nonzeros(const long long *matrix, int n) {
+    size_t i, count = (size_t) n * n;
+    long long nnz = 0;
+    for (i = 0; i < count; ++i) {
+        nnz += matrix[i] != 0;
+    }
+    return nnz;
+}
+
+/**
+ * Converts a dense matrix to the CSR format
+ * @param matrix    contiguous matrix
+ * @param n         matrix size
+ * @param csr       destination
+ */
+void dense_to_csr(const long long *matrix, int n, csr_matrix_t *csr) {
+    reserve_csr(csr, n, (size_t) count_nonzeros(matrix, n));
+
+    long long nnz = 0;
+    int i, j;
+    for (i = 0; i < n; ++i) {
+        const long long *row = matrix + (size_t) i * n;
+        csr->row_ptr[i] = nnz;
+        for (j = 0; j < n; ++j) {
+            if (row[j] != 0) {
+                csr->columns[nnz] = j;
+                csr->values[nnz++] = row[j];
+            }
+        }
+    }
+    csr->row_ptr[n] = nnz;
+    csr->nnz = nnz;
+}
+
+/**
+ * Expands a CSR matrix to a dense one
+ * @param csr       pointer of an csr_matrix_t
+ * @param matrix    destination, n * n contiguous elements
+ */
+void csr_to_dense(const csr_matrix_t *csr, long long *matrix) {
+    int n = csr->n;
+    memset(matrix, 0, sizeof(long long) * n * n);
+
+    int i;
+    long long p;
+    for (i = 0; i < n; ++i) {
+        long long *row = matrix + (size_t) i * n;
+        for (p = csr->row_ptr[i]; p < csr->row_ptr[i + 1]; ++p) {
+            row[csr->columns[p]] = csr->values[p];
+        }
+    }
+}
+
+/**
+ * Sparse squaring, C = A * A. Column indices of C rows are not sorted and
+ * elements that sum up to zero are dropped.
+ * @param a         pointer of an csr_matrix_t
+ * @param c         destination, must not be A
+ * @param workspace accumulator, kept between calls
+ * @return multiply-add count
+ */
+long long csr_square(const csr_matrix_t *a, csr_matrix_t *c, csr_workspace_t *workspace) {
+    int n = a->n;
+    if (workspace->n < n) {
+        free_csr_workspace(workspace);
+        workspace->sums = (unsigned long long *) malloc(sizeof(unsigned long long) * n);
+        workspace->marker = (int *) malloc(sizeof(int) * n);
+        workspace->pattern = (int *) malloc(sizeof(int) * n);
+        if (!workspace->sums || !workspace->marker || !workspace->pattern) {
+            exit(EXIT_FAILURE);
+        }
+        workspace->n = n;
+    }
+    unsigned long long *sums = workspace->sums;
+    int *marker = workspace->marker;
+    int *pattern = workspace->pattern;
+
+    int i;
+    for (i = 0; i < n; ++i) {
+        marker[i] = -1;
+    }
+
+    size_t capacity = c->capacity > (size_t) a->nnz ? c->capacity : (size_t) a->nnz;
+    reserve_csr(c, n, capacity > (size_t) n ? capacity : (size_t) n);
+    const unsigned long long *values = (const unsigned long long *) a->values;
+
+    long long nnz = 0, products = 0, p, q;
+    for (i = 0; i < n; ++i) {
+        int count = 0;
+        for (p = a->row_ptr[i]; p < a->row_ptr[i + 1]; ++p) {
+            int k = a->columns[p];
+            unsigned long long aik = values[p];
+            products += a->row_ptr[k + 1] - a->row_ptr[k];
+            for (q = a->row_ptr[k]; q < a->row_ptr[k + 1]; ++q) {
+                int j = a->columns[q];
+                if (marker[j] != i) {
+                    marker[j] = i;
+                    sums[j] = 0;
+                    pattern[count++] = j;
+                }
+                sums[j] += aik * values[q];
+            }
+        }
+
+        /* a row has n elements at most */
+        if ((size_t) nnz + count > c->capacity) {
+            size_t grown = c->capacity * 2;
+            reserve_csr(c, n, grown > (size_t) nnz + n ? grown : (size_t) nnz + n);
+        }
+        c->row_ptr[i] = nnz;
+        for (p = 0; p < count; ++p) {
+            int j = pattern[p];
+            if (sums[j] != 0) {
+                c->columns[nnz] = j;
+                c->values[nnz++] = (long long) sums[j];
+            }
+        }
+    }
+    c->row_ptr[n] = nnz;
+    c->nnz = nnz;
+    return products;
+}
+
+/**
+ * Deallocates the accumulator of csr_square
+ * @param workspace pointer of an csr_workspace_t
+ */
+void free_csr_workspace(csr_workspace_t *workspace) {
+    free(workspace->sums);
+    free(workspace->marker);
+    free(workspace->pattern);
+    memset(workspace, 0, sizeof(csr_workspace_t));
+}
+
+/**
+ * Size of a CSR matrix on a pipe, without its frame
+ * @param csr   pointer of an csr_matrix_t
+ * @return byte count
+ */
+long long csr_bytes(const csr_matrix_t *csr) {
+    return (long long) sizeof(long long) * (csr->n + 1) +
+           (long long) (sizeof(int) + sizeof(long long)) * csr->nnz;
+}
+
+/**
+ * Writes a CSR matrix with its frame to a pipe in one writev
+ * @param fd    file descriptor
+ * @param csr   pointer of an csr_matrix_t
+ * @return 1 on success, 0 on error
+ */
+int write_csr(int fd, const csr_matrix_t *csr) {
+    matrix_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.n = csr->n;
+    frame.format = FRAME_CSR;
+    frame.nnz = csr->nnz;
+
+    struct iovec iov[4];
+    iov[0].iov_base = &frame;
+    iov[0].iov_len = sizeof(frame);
+    iov[1].iov_base = csr->row_ptr;
+    iov[1].iov_len = sizeof(long long) * (csr->n + 1);
+    iov[2].iov_base = csr->columns;
+    iov[2].iov_len = sizeof(int) * csr->nnz;
+    iov[3].iov_base = csr->values;
+    iov[3].iov_len = sizeof(long long) * csr->nnz;
+    return writev_full(fd, iov, 4);
+}
+
+/**
+ * Reads the body of a CSR frame
+ * @param fd    file descriptor
+ * @param frame header that is already read
+ * @param csr   destination
+ * @return 1 on success, 0 on error
+ */
+int read_csr(int fd, const matrix_frame_t *frame, csr_matrix_t *csr) {
+    reserve_csr(csr, frame->n, (size_t) frame->nnz);
+    csr->nnz = frame->nnz;
+    return read_full(fd, csr->row_ptr, sizeof(long long) * (frame->n + 1)) &&
+           read_full(fd, csr->columns, sizeof(int) * frame->nnz) &&
+           read_full(fd, csr->values, sizeof(long long) * frame->nnz);
+}
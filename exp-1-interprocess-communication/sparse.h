@@ -0,0 +1,48 @@
+#ifndef BBM342_EXP1_SPARSE_H
+#define BBM342_EXP1_SPARSE_H
+
+#include <stddef.h>
+
+#define FRAME_DENSE 0
+#define FRAME_CSR   1
+
+/* Header of every matrix on a pipe, followed by its elements */
+typedef struct matrix_frame {
+    int n;           /* 0 marks the end of stream */
+    int format;      /* FRAME_DENSE or FRAME_CSR */
+    long long nnz;   /* element count of a CSR matrix */
+} matrix_frame_t;
+
+/* Compressed sparse row matrix */
+typedef struct csr_matrix {
+    int n;
+    long long nnz;
+    long long *row_ptr;  /* n + 1 offsets */
+    int *columns;
+    long long *values;
+    size_t capacity;     /* allocated elements of columns and values */
+} csr_matrix_t;
+
+/* Dense row accumulator of the sparse squaring */
+typedef struct csr_workspace {
+    unsigned long long *sums;
+    int *marker;
+    int *pattern;
+    int n;
+} csr_workspace_t;
+
+void init_csr(csr_matrix_t *csr);
+void reserve_csr(csr_matrix_t *csr, int n, size_t capacity);
+void free_csr(csr_matrix_t *csr);
+
+long long count_nonzeros(const long long *matrix, int n);
+void dense_to_csr(const long long *matrix, int n, csr_matrix_t *csr);
+void csr_to_dense(const csr_matrix_t *csr, long long *matrix);
+long long csr_square(const csr_matrix_t *a, csr_matrix_t *c, csr_workspace_t *workspace);
+void free_csr_workspace(csr_workspace_t *workspace);
+
+long long csr_bytes(const csr_matrix_t *csr);
+int write_csr(int fd, const csr_matrix_t *csr);
+int read_csr(int fd, const matrix_frame_t *frame, csr_matrix_t *csr);
+
+#endif
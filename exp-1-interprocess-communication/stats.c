@@ -0,0 +1,134 @@
+/**
+ * BBM 342 Operating Systems
+ * Experiment 1
+ * Per-process timing of the process chain
+ *
+ * Every process splits its wall clock time into receive, compute, print and
+ * send phases and counts the bytes and multiply-adds of its matrices. When
+ * it finishes, it writes one fixed-size record to a stats pipe, which is
+ * smaller than PIPE_BUF so records of different processes never interleave.
+ * The main process reads them all after the chain is done and writes a tab
+ * separated summary, one line per process.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "transport.h"
+
+static int compare_stats(const void *a, const void *b);
+
+/**
+ * Monotonic clock
+ * @return seconds
+ */
+double stats_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Starts the timings of a process
+ * @param stats pointer of an stage_stats_t
+ * @param pnum  process number
+ */
+void init_stats(stage_stats_t *stats, int pnum) {
+    memset(stats, 0, sizeof(stage_stats_t));
+    stats->pnum = pnum;
+    stats->pid = (int) getpid();
+    stats->started = stats_clock();
+}
+
+/**
+ * Adds the time since the given moment to a phase
+ * @param stats pointer of an stage_stats_t
+ * @param phase PHASE_RECEIVE, PHASE_COMPUTE, PHASE_PRINT or PHASE_SEND
+ * @param since stats_clock() at the start of the phase
+ * @return now, the start of the next phase
+ */
+double stats_lap(stage_stats_t *stats, int phase, double since) {
+    double now = stats_clock();
+    stats->seconds[phase] += now - since;
+    return now;
+}
+
+/**
+ * Sends the timings of a finished process to the main process
+ * @param fd    write end of the stats pipe, ignored if negative
+ * @param stats pointer of an stage_stats_t
+ */
+void report_stats(int fd, stage_stats_t *stats) {
+    if (fd < 0) {
+        return;
+    }
+    stats->elapsed = stats_clock() - stats->started;
+    write_full(fd, stats, sizeof(stage_stats_t));
+}
+
+/**
+ * Reads timings until every process closed the stats pipe and writes them
+ * as a tab separated table ordered by process number
+ * @param fd    read end of the stats pipe
+ * @param path  summary file, "-" for stderr
+ * @return 0 on success, -1 on error
+ */
+int write_stats_summary(int fd, const char *path) {
+    size_t count = 0, capacity = 16;
+    stage_stats_t *records = (stage_stats_t *) malloc(sizeof(stage_stats_t) * capacity);
+    if (!records) {
+        return -1;
+    }
+    while (read_full(fd, &records[count], sizeof(stage_stats_t))) {
+        if (++count == capacity) {
+            capacity *= 2;
+            records = (stage_stats_t *) realloc(records, sizeof(stage_stats_t) * capacity);
+            if (!records) {
+                return -1;
+            }
+        }
+    }
+    qsort(records, count, sizeof(stage_stats_t), compare_stats);
+
+    FILE *out = strcmp(path, "-") == 0 ? stderr : fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot open %s.\n", path);
+        free(records);
+        return -1;
+    }
+    fprintf(out, "process\tpid\tmatrices\telapsed_s\treceive_s\tcompute_s\tprint_s\tsend_s"
+                 "\tbytes_in\tbytes_out\tmadds_per_s\n");
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        const stage_stats_t *s = &records[i];
+        double compute = s->seconds[PHASE_COMPUTE];
+        fprintf(out, "%d\t%d\t%ld\t%.6f\t%.6f\t%.6f\t%.6f\t%.6f\t%lld\t%lld\t%.0f\n",
+                s->pnum, s->pid, s->matrices, s->elapsed,
+                s->seconds[PHASE_RECEIVE], compute,
+                s->seconds[PHASE_PRINT], s->seconds[PHASE_SEND],
+                s->bytes_in, s->bytes_out,
+                compute > 0 ? s->multiply_adds / compute : 0.0);
+    }
+    if (out != stderr) {
+        fclose(out);
+    }
+    free(records);
+    return 0;
+}
+
+/**
+ * Orders timings by process number
+ * @param a pointer of an stage_stats_t
+ * @param b pointer of an stage_stats_t
+ * @return difference of process numbers
+ */
+static int compare_stats(const void *a, const void *b) {
+    return ((const stage_stats_t *) a)->pnum - ((const stage_stats_t *) b)->pnum;
+}
@@ -0,0 +1,29 @@
+#ifndef BBM342_EXP1_STATS_H
+#define BBM342_EXP1_STATS_H
+
+#define PHASE_RECEIVE   0   /* reading the input or the previous pipe */
+#define PHASE_COMPUTE   1
+#define PHASE_PRINT     2   /* formatting and writing results */
+#define PHASE_SEND      3   /* blocked on the next process */
+#define PHASE_COUNT     4
+
+/* Timings of one process, sent to the main process when it finishes */
+typedef struct stage_stats {
+    int pnum;               /* process number, pcount for the collector */
+    int pid;
+    long matrices;
+    double started;         /* stats_clock() at init_stats */
+    double elapsed;         /* seconds from init_stats to report_stats */
+    double seconds[PHASE_COUNT];
+    long long bytes_in;     /* matrix bytes received */
+    long long bytes_out;    /* matrix bytes sent */
+    double multiply_adds;
+} stage_stats_t;
+
+double stats_clock(void);
+void init_stats(stage_stats_t *stats, int pnum);
+double stats_lap(stage_stats_t *stats, int phase, double since);
+void report_stats(int fd, stage_stats_t *stats);
+int write_stats_summary(int fd, const char *path);
+
+#endif
@@ -0,0 +1,242 @@
+/**
+ * BBM 342 Operating Systems
+ * Experiment 1
+ * Tile-level work distribution across worker processes
+ *
+ * Instead of a chain, the child processes work as a pool. The main process
+ * keeps the matrix and its square in two shared memory slots, splits every
+ * squaring into output tiles and hands tile jobs to whichever worker is free
+ * over the job pipes. Workers report finished tiles over one shared done
+ * pipe. Every squaring is complete before the next one starts, so the
+ * latency of a single A^(2^k) computation drops with more workers.
+ *
+ * Pipe layout: pipefd[0] is the done pipe, pipefd[i] is the job pipe of
+ * worker i.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tiles.h"
+
+#define JOBS_IN_FLIGHT  2   /* jobs queued on a worker's pipe at most */
+#define MIN_TILE_SIZE   64
+
+static void send_tile_job(pipeline_t *pipeline, int worker, int n, int source,
+                          int tile, int tile_index);
+
+/**
+ * Main process work of the tile pool mode.
+ * Reads the input matrices and squares every one of them pcount - 1 times
+ * with the workers. The result of the i-th squaring is printed as the
+ * result of process i of the chain.
+ * @param pipeline  pipes and options, pipeline->pcount - 1 workers
+ * @param slots     two shared memory slots
+ */
+void tile_main_work(pipeline_t *pipeline, shm_slot_t *slots) {
+    int pcount = pipeline->pcount;
+    int workers = pcount - 1;
+    close_tile_pipefd(pipeline->pipefd, 0, pcount);
+
+    int* outs = (int*) malloc(sizeof(int) * pcount);
+    if (!outs) {
+        exit(EXIT_FAILURE);
+    }
+    int i;
+    for (i = 0; i < pcount; ++i) {
+        outs[i] = -1;
+    }
+
+    const char* input = pipeline->options->input;
+    matrix_reader_t* reader = open_matrix_reader(input);
+    if (reader == NULL) {
+        fprintf(stderr, "Cannot open %s.\n", input);
+        exit(EXIT_FAILURE);
+    }
+
+    stage_stats_t stats;
+    init_stats(&stats, 0);
+    double t = stats_clock();
+    int n;
+    while ((n = next_matrix_size(reader)) > 0) {
+        size_t size = sizeof(long long) * n * n;
+        map_slot(&slots[1], size, 1);
+        if (!read_matrix_values(reader, map_slot(&slots[0], size, 1), n)) {
+            fprintf(stderr, "Matrix in %s is truncated.\n", input);
+            break;
+        }
+        t = stats_lap(&stats, PHASE_RECEIVE, t);
+        stats.matrices++;
+
+        int tile = choose_tile_size(n, workers);
+        int grid = (n + tile - 1) / tile;
+        int source = 0, step;
+        for (step = 1; step < pcount; ++step) {
+            int jobs = grid * grid, next = 0, in_flight = 0, w, k;
+
+            /* fill the job pipes, then feed workers as they finish */
+            for (k = 0; k < JOBS_IN_FLIGHT; ++k) {
+                for (w = 1; w <= workers && next < jobs; ++w) {
+                    send_tile_job(pipeline, w, n, source, tile, next++);
+                    in_flight++;
+                }
+            }
+            while (in_flight > 0) {
+                tile_done_t done;
+                if (!read_full(pipeline->pipefd[0][0], &done, sizeof(done))) {
+                    fprintf(stderr, "A tile worker is gone.\n");
+                    exit(EXIT_FAILURE);
+                }
+                in_flight--;
+                if (next < jobs) {
+                    send_tile_job(pipeline, done.worker, n, source, tile, next++);
+                    in_flight++;
+                }
+            }
+
+            source ^= 1;
+            t = stats_lap(&stats, PHASE_COMPUTE, t);
+            stats.multiply_adds += (double) n * n * n;
+            if (outs[step] < 0) {
+                outs[step] = open_output(pipeline->options, step);
+            }
+            print_matrix(outs[step], slots[source].data, n, step, pipeline->options);
+            t = stats_lap(&stats, PHASE_PRINT, t);
+        }
+    }
+    close_matrix_reader(reader);
+    report_stats(pipeline->statsfd[1], &stats);
+
+    /* stop the workers */
+    for (i = 1; i < pcount; ++i) {
+        tile_job_t job;
+        memset(&job, 0, sizeof(job));
+        write_full(pipeline->pipefd[i][1], &job, sizeof(job));
+        close(pipeline->pipefd[i][1]);
+        if (outs[i] >= 0) {
+            close(outs[i]);
+        }
+    }
+    close(pipeline->pipefd[0][0]);
+
+    free(outs);
+    destroy_shm_slot(&slots[0]);
+    destroy_shm_slot(&slots[1]);
+    free_pipefd(pipeline->pipefd, pcount);
+}
+
+/**
+ * Worker process work of the tile pool mode.
+ * Computes the tiles that it receives until an empty job comes.
+ * @param pipeline  pipes and options
+ * @param slots     two shared memory slots
+ * @param pnum      worker number, 1, 2 and so on
+ */
+void tile_worker_work(pipeline_t *pipeline, shm_slot_t *slots, int pnum) {
+    int pcount = pipeline->pcount;
+    close_tile_pipefd(pipeline->pipefd, pnum, pcount);
+    pipeline->pool = create_kernel_pool(pipeline->options->threads); /* threads do not survive fork */
+
+    stage_stats_t stats;
+    init_stats(&stats, pnum);
+    double t = stats_clock();
+
+    tile_job_t job;
+    while (read_full(pipeline->pipefd[pnum][0], &job, sizeof(job)) && job.n > 0) {
+        t = stats_lap(&stats, PHASE_RECEIVE, t);
+        int n = job.n;
+        size_t size = sizeof(long long) * n * n;
+        const long long* a = map_slot(&slots[job.source], size, 0);
+        long long* c = map_slot(&slots[job.source ^ 1], size, 0);
+
+        /* C[row.., column..] = A[row.., *] * A[*, column..] */
+        pool_matrix_mult(pipeline->pool, job.rows, job.columns, n,
+                         a + (size_t) job.row * n, n,
+                         a + job.column, n,
+                         c + (size_t) job.row * n + job.column, n, 0);
+        t = stats_lap(&stats, PHASE_COMPUTE, t);
+
+        tile_done_t done;
+        done.worker = pnum;
+        write_full(pipeline->pipefd[0][1], &done, sizeof(done)); /* atomic, smaller than PIPE_BUF */
+        t = stats_lap(&stats, PHASE_SEND, t);
+        stats.matrices++; /* tiles */
+        stats.multiply_adds += (double) job.rows * job.columns * n;
+    }
+    report_stats(pipeline->statsfd[1], &stats);
+
+    close(pipeline->pipefd[pnum][0]);
+    close(pipeline->pipefd[0][1]);
+
+    destroy_kernel_pool(pipeline->pool);
+    destroy_shm_slot(&slots[0]);
+    destroy_shm_slot(&slots[1]);
+    free_pipefd(pipeline->pipefd, pcount);
+}
+
+/**
+ * Closes unnecessary pipe file descriptors of the tile pool mode
+ * @param pipefd    pipe file descriptors
+ * @param pnum      process number. 0(main process), 1, 2 and so on
+ * @param pcount    total process count
+ */
+void close_tile_pipefd(int** pipefd, int pnum, int pcount) {
+    int i;
+    for (i = 0; i < pcount; ++i) {
+        if (i == 0) {
+            close(pipefd[0][pnum == 0 ? 1 : 0]); /* main reads, workers write */
+        } else if (pnum == 0) {
+            close(pipefd[i][0]);
+        } else {
+            close(pipefd[i][1]);
+            if (i != pnum) {
+                close(pipefd[i][0]);
+            }
+        }
+    }
+}
+
+/**
+ * Chooses the size of the square output tiles so that every worker gets
+ * a few of them in a squaring.
+ * @param n         matrix size
+ * @param workers   worker count
+ * @return tile size
+ */
+int choose_tile_size(int n, int workers) {
+    int grid = 1;
+    while (grid * grid < 4 * workers) {
+        grid++;
+    }
+    int tile = (n + grid - 1) / grid;
+    tile = (tile + KERNEL_MR - 1) / KERNEL_MR * KERNEL_MR;
+    tile = tile < MIN_TILE_SIZE ? MIN_TILE_SIZE : tile;
+    return tile < n ? tile : n;
+}
+
+/**
+ * Sends a tile job to a worker
+ * @param pipeline      pipes of the pool
+ * @param worker        worker number
+ * @param n             matrix size
+ * @param source        shared slot of the matrix
+ * @param tile          tile size
+ * @param tile_index    row major index of the tile
+ */
+static void send_tile_job(pipeline_t *pipeline, int worker, int n, int source,
+                          int tile, int tile_index) {
+    int grid = (n + tile - 1) / tile;
+    tile_job_t job;
+    job.n = n;
+    job.source = source;
+    job.row = tile_index / grid * tile;
+    job.column = tile_index % grid * tile;
+    job.rows = n - job.row < tile ? n - job.row : tile;
+    job.columns = n - job.column < tile ? n - job.column : tile;
+    write_full(pipeline->pipefd[worker][1], &job, sizeof(job));
+}
@@ -0,0 +1,24 @@
+#ifndef BBM342_EXP1_TILES_H
+#define BBM342_EXP1_TILES_H
+
+#include "process.h"
+
+/* Output tile of one squaring, sent from the main process to a worker */
+typedef struct tile_job {
+    int n;
+    int source;  /* shared slot of the matrix, the result goes to the other */
+    int row, rows;
+    int column, columns;
+} tile_job_t;
+
+/* Sent by a worker over the shared done pipe when its tile is ready */
+typedef struct tile_done {
+    int worker;
+} tile_done_t;
+
+void tile_main_work(pipeline_t *pipeline, shm_slot_t *slots);
+void tile_worker_work(pipeline_t *pipeline, shm_slot_t *slots, int pnum);
+void close_tile_pipefd(int** pipefd, int pnum, int pcount);
+int choose_tile_size(int n, int workers);
+
+#endif
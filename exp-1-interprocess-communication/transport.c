@@ -0,0 +1,260 @@
+/**
+ * BBM 342 Operating Systems
+ * Experiment 1
+ * Pipe helpers and shared memory matrix transport
+ *
+ * Every link of the process chain owns two memfd buffers. The writer fills
+ * a free buffer in place and sends only its size and slot number over the
+ * data pipe. The reader uses the buffer directly and gives it back with a
+ * single byte over the acknowledgement pipe. Buffers grow with ftruncate and
+ * every process remaps them lazily, so no matrix is copied between processes.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "transport.h"
+
+/**
+ * Reads exactly size bytes, retrying short reads of the pipe.
+ * @param fd    file descriptor
+ * @param buf   destination
+ * @param size  byte count
+ * @return 1 on success, 0 on end of file or error
+ */
+int read_full(int fd, void *buf, size_t size) {
+    char *p = (char *) buf;
+    while (size > 0) {
+        ssize_t r = read(fd, p, size);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return 0;
+        }
+        p += r;
+        size -= (size_t) r;
+    }
+    return 1;
+}
+
+/**
+ * Writes exactly size bytes, retrying short writes of the pipe.
+ * @param fd    file descriptor
+ * @param buf   source
+ * @param size  byte count
+ * @return 1 on success, 0 on error
+ */
+int write_full(int fd, const void *buf, size_t size) {
+    const char *p = (const char *) buf;
+    while (size > 0) {
+        ssize_t w = write(fd, p, size);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return 0;
+        }
+        p += w;
+        size -= (size_t) w;
+    }
+    return 1;
+}
+
+/**
+ * Writes every buffer of an iovec array, retrying short writes.
+ * @param fd    file descriptor
+ * @param iov   buffers, modified on short writes
+ * @param count buffer count
+ * @return 1 on success, 0 on error
+ */
+int writev_full(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t w = writev(fd, iov, count);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return 0;
+        }
+        /* skip fully written buffers and advance the partial one */
+        while (count > 0 && (size_t) w >= iov->iov_len) {
+            w -= (ssize_t) iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + w;
+            iov->iov_len -= (size_t) w;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Creates an empty shared memory slot. Must be called before fork so that
+ * every process inherits the memfd.
+ * @param slot destination slot
+ */
+void create_shm_slot(shm_slot_t *slot) {
+    slot->fd = memfd_create("bbm342-matrix", 0);
+    if (slot->fd < 0) {
+        fprintf(stderr, "Create shared memory failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    slot->data = NULL;
+    slot->mapped = 0;
+}
+
+/**
+ * Unmaps and closes a shared memory slot of this process
+ * @param slot the slot
+ */
+void destroy_shm_slot(shm_slot_t *slot) {
+    if (slot->data) {
+        munmap(slot->data, slot->mapped);
+    }
+    close(slot->fd);
+}
+
+/**
+ * Creates shared memory links. Must be called before fork so that every
+ * process inherits the memfds.
+ * @param count link count
+ * @return address of the links
+ */
+shm_link_t* create_shm_links(int count) {
+    shm_link_t *links = (shm_link_t *) malloc(sizeof(shm_link_t) * count);
+    if (!links) {
+        exit(EXIT_FAILURE);
+    }
+
+    int i;
+    for (i = 0; i < count; ++i) {
+        create_shm_slot(&links[i].slot[0]);
+        create_shm_slot(&links[i].slot[1]);
+        links[i].credits = 2;
+        links[i].next = 0;
+    }
+    return links;
+}
+
+/**
+ * Unmaps and closes shared memory links of this process
+ * @param links link array
+ * @param count link count
+ * @see create_shm_links
+ */
+void destroy_shm_links(shm_link_t *links, int count) {
+    int i;
+    for (i = 0; i < count; ++i) {
+        destroy_shm_slot(&links[i].slot[0]);
+        destroy_shm_slot(&links[i].slot[1]);
+    }
+    free(links);
+}
+
+/**
+ * Takes a free slot of the link to write an n x n matrix in it. Blocks
+ * until the reader releases a slot if both of them are in use.
+ * @param link          the link
+ * @param ack_read_end  read end of the acknowledgement pipe
+ * @param n             matrix size
+ * @return matrix address in the shared slot
+ */
+long long* shm_acquire(shm_link_t *link, int ack_read_end, int n) {
+    if (link->credits == 0) {
+        char slot;
+        if (!read_full(ack_read_end, &slot, sizeof(slot))) {
+            fprintf(stderr, "Reader of the shared memory link is gone.\n");
+            exit(EXIT_FAILURE);
+        }
+        link->credits++;
+    }
+    return map_slot(&link->slot[link->next], sizeof(long long) * n * n, 1);
+}
+
+/**
+ * Hands the slot taken by shm_acquire to the reader.
+ * @param link      the link
+ * @param write_end write end of the data pipe
+ * @param n         matrix size
+ */
+void shm_publish(shm_link_t *link, int write_end, int n) {
+    shm_message_t message;
+    message.n = n;
+    message.slot = link->next;
+    write_full(write_end, &message, sizeof(message));
+
+    link->credits--;
+    link->next ^= 1;
+}
+
+/**
+ * Waits for a matrix on the link.
+ * @param link      the link
+ * @param read_end  read end of the data pipe
+ * @param n         destination of the matrix size
+ * @param slot      destination of the slot number, see shm_release
+ * @return matrix address in the shared slot, NULL on end of stream
+ */
+long long* shm_receive(shm_link_t *link, int read_end, int *n, int *slot) {
+    shm_message_t message;
+    if (!read_full(read_end, &message, sizeof(message)) || message.n <= 0) {
+        return NULL;
+    }
+    *n = message.n;
+    *slot = message.slot;
+    return map_slot(&link->slot[message.slot], sizeof(long long) * message.n * message.n, 0);
+}
+
+/**
+ * Gives a received slot back to the writer.
+ * @param ack_write_end write end of the acknowledgement pipe
+ * @param slot          slot number returned by shm_receive
+ */
+void shm_release(int ack_write_end, int slot) {
+    char s = (char) slot;
+    write_full(ack_write_end, &s, sizeof(s));
+}
+
+/**
+ * Makes sure that at least size bytes of the slot are mapped.
+ * @param slot  the slot
+ * @param size  required byte count
+ * @param grow  nonzero if the memfd may be extended (writer side)
+ * @return address of the mapping
+ */
+long long* map_slot(shm_slot_t *slot, size_t size, int grow) {
+    if (slot->mapped >= size && slot->data) {
+        return slot->data;
+    }
+
+    if (grow) {
+        struct stat st;
+        if (fstat(slot->fd, &st) < 0 || (size_t) st.st_size < size) {
+            if (ftruncate(slot->fd, (off_t) size) < 0) {
+                fprintf(stderr, "Resize shared memory failed.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    if (slot->data) {
+        munmap(slot->data, slot->mapped);
+    }
+    slot->data = (long long *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, slot->fd, 0);
+    if (slot->data == MAP_FAILED) {
+        fprintf(stderr, "Map shared memory failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    slot->mapped = size;
+    return slot->data;
+}
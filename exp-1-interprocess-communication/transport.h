@@ -0,0 +1,43 @@
+#ifndef BBM342_EXP1_TRANSPORT_H
+#define BBM342_EXP1_TRANSPORT_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+/* A memfd backed buffer that is shared by every process of the chain */
+typedef struct shm_slot {
+    int fd;
+    long long *data;
+    size_t mapped; /* mapped bytes in this process */
+} shm_slot_t;
+
+/* Double-buffered link between a writer process and a reader process */
+typedef struct shm_link {
+    shm_slot_t slot[2];
+    int credits; /* free slots known by the writer */
+    int next;    /* next slot the writer fills */
+} shm_link_t;
+
+/* Ready notification sent over the data pipe of a link */
+typedef struct shm_message {
+    int n;
+    int slot;
+} shm_message_t;
+
+int read_full(int fd, void *buf, size_t size);
+int write_full(int fd, const void *buf, size_t size);
+int writev_full(int fd, struct iovec *iov, int count);
+
+void create_shm_slot(shm_slot_t *slot);
+void destroy_shm_slot(shm_slot_t *slot);
+long long* map_slot(shm_slot_t *slot, size_t size, int grow);
+
+shm_link_t* create_shm_links(int count);
+void destroy_shm_links(shm_link_t *links, int count);
+
+long long* shm_acquire(shm_link_t *link, int ack_read_end, int n);
+void shm_publish(shm_link_t *link, int write_end, int n);
+long long* shm_receive(shm_link_t *link, int read_end, int *n, int *slot);
+void shm_release(int ack_write_end, int slot);
+
+#endif
@@ -0,0 +1,263 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * Lock-free file buffer
+ *
+ * A bounded ring in the style of Dmitry Vyukov's MPMC queue. Producers and
+ * consumers claim positions with a compare-and-swap on in and out, and
+ * every cell carries a sequence number that tells whether it is free or
+ * full for a position. A batch claims a run of consecutive ready cells with
+ * a single compare-and-swap. Threads that find the ring full or empty spin
+ * briefly and then sleep on a futex, which is woken only if somebody sleeps.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "buffer.h"
+
+#define SPIN_COUNT 64 /* tries before sleeping */
+
+/* sequence of a cell that is free or full for a position. Doubled, so that
+ * "full for pos" and "free for pos + size" differ even when size is 1 */
+#define FREE(pos) ((pos) * 2)
+#define FULL(pos) ((pos) * 2 + 1)
+
+static int try_put(buffer_t *buffer, void **values, int count);
+static int try_get(buffer_t *buffer, void **values, int count);
+static void wait_on(int *word, int *waiters, buffer_t *buffer, int putting);
+static void wake_up(int *word, int *waiters);
+
+/**
+ * Creates a buffer
+ * @param size size of the buffer
+ * @return pointer of an buffer_t
+ */
+buffer_t* create_buffer(int size) {
+    buffer_t *buffer = (buffer_t *) calloc(1, sizeof(buffer_t));
+    buffer->size = size > 0 ? (size_t) size : 1;
+    buffer->cells = (buffer_cell_t *) malloc(buffer->size * sizeof(buffer_cell_t));
+
+    size_t i;
+    for (i = 0; i < buffer->size; ++i) {
+        buffer->cells[i].sequence = FREE(i); /* free for the first round */
+    }
+    return buffer;
+}
+
+/**
+ * Puts the specified item to the buffer, waits while it is full.
+ * @param buffer pointer of an buffer_t
+ * @param value item to be put to the buffer
+ */
+void put_buffer(buffer_t *buffer, void *value) {
+    put_many(buffer, &value, 1);
+}
+
+/**
+ * Reads an item from the buffer, waits while it is empty.
+ * @param buffer pointer of an buffer_t
+ * @return an item from the buffer
+ */
+void *read_buffer(buffer_t *buffer) {
+    void *item;
+    get_many(buffer, &item, 1);
+    return item;
+}
+
+/**
+ * Puts items to the buffer in order, waits while it is full.
+ * @param buffer pointer of an buffer_t
+ * @param values items to be put to the buffer
+ * @param count item count
+ */
+void put_many(buffer_t *buffer, void **values, int count) {
+    while (count > 0) {
+        int put = try_put(buffer, values, count);
+        if (put == 0) {
+            wait_on(&buffer->not_full, &buffer->full_waiters, buffer, 1);
+            continue;
+        }
+        values += put;
+        count -= put;
+        wake_up(&buffer->not_empty, &buffer->empty_waiters);
+    }
+}
+
+/**
+ * Reads at least one and at most count items from the buffer, waits while
+ * it is empty. Stops after a NULL, so every consumer gets its own sentinel.
+ * @param buffer pointer of an buffer_t
+ * @param values read items
+ * @param count maximum item count
+ * @return read item count
+ */
+int get_many(buffer_t *buffer, void **values, int count) {
+    while (1) {
+        int got = try_get(buffer, values, count);
+        if (got > 0) {
+            wake_up(&buffer->not_full, &buffer->full_waiters);
+            return got;
+        }
+        wait_on(&buffer->not_empty, &buffer->empty_waiters, buffer, 0);
+    }
+}
+
+/**
+ * Reads at most count items from the buffer without waiting. Stops after a
+ * NULL like get_many.
+ * @param buffer pointer of an buffer_t
+ * @param values read items
+ * @param count maximum item count
+ * @return read item count, 0 if the buffer is empty
+ */
+int try_get_many(buffer_t *buffer, void **values, int count) {
+    int got = try_get(buffer, values, count);
+    if (got > 0) {
+        wake_up(&buffer->not_full, &buffer->full_waiters);
+    }
+    return got;
+}
+
+/**
+ * Deallocate dynamic parameters of the buffer and then deallocate itself.
+ * @param buffer pointer of an buffer_t
+ */
+void destroy_buffer(buffer_t *buffer) {
+    free(buffer->cells);
+    free(buffer);
+}
+
+/**
+ * Claims the free cells from in onwards and fills them.
+ * @param buffer pointer of an buffer_t
+ * @param values items to be put
+ * @param count item count
+ * @return put item count, 0 if the buffer is full
+ */
+static int try_put(buffer_t *buffer, void **values, int count) {
+    size_t pos = __atomic_load_n(&buffer->in, __ATOMIC_RELAXED);
+    while (1) {
+        int n = 0;
+        while (n < count) {
+            buffer_cell_t *cell = &buffer->cells[(pos + n) % buffer->size];
+            size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            if (sequence != FREE(pos + n)) {
+                break;
+            }
+            n++;
+        }
+        if (n == 0) {
+            buffer_cell_t *cell = &buffer->cells[pos % buffer->size];
+            long difference = (long) (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - FREE(pos));
+            if (difference < 0) {
+                return 0; /* a full round behind, the buffer is full */
+            }
+            pos = __atomic_load_n(&buffer->in, __ATOMIC_RELAXED); /* somebody else took it */
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&buffer->in, &pos, pos + n, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            int i;
+            for (i = 0; i < n; ++i) {
+                buffer_cell_t *cell = &buffer->cells[(pos + i) % buffer->size];
+                cell->item = values[i];
+                __atomic_store_n(&cell->sequence, FULL(pos + i), __ATOMIC_RELEASE);
+            }
+            return n;
+        }
+        /* pos is reloaded by the failed compare-and-swap */
+    }
+}
+
+/**
+ * Claims the full cells from out onwards, up to the first NULL item.
+ * @param buffer pointer of an buffer_t
+ * @param values read items
+ * @param count maximum item count
+ * @return read item count, 0 if the buffer is empty
+ */
+static int try_get(buffer_t *buffer, void **values, int count) {
+    size_t pos = __atomic_load_n(&buffer->out, __ATOMIC_RELAXED);
+    while (1) {
+        int n = 0;
+        while (n < count) {
+            buffer_cell_t *cell = &buffer->cells[(pos + n) % buffer->size];
+            size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            if (sequence != FULL(pos + n)) {
+                break;
+            }
+            values[n] = cell->item; /* only valid if the claim succeeds */
+            if (values[n++] == NULL) {
+                break;
+            }
+        }
+        if (n == 0) {
+            buffer_cell_t *cell = &buffer->cells[pos % buffer->size];
+            long difference = (long) (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - FULL(pos));
+            if (difference < 0) {
+                return 0; /* not written yet, the buffer is empty */
+            }
+            pos = __atomic_load_n(&buffer->out, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&buffer->out, &pos, pos + n, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            int i;
+            for (i = 0; i < n; ++i) {
+                buffer_cell_t *cell = &buffer->cells[(pos + i) % buffer->size];
+                __atomic_store_n(&cell->sequence, FREE(pos + i + buffer->size), __ATOMIC_RELEASE);
+            }
+            return n;
+        }
+    }
+}
+
+/**
+ * Spins for a while and then sleeps until the buffer changes. The waiter
+ * is registered before checking the buffer again, so a change after the
+ * check always finds it.
+ * @param word futex word of the awaited change
+ * @param waiters sleeper count of the word
+ * @param buffer pointer of an buffer_t
+ * @param putting 1 to wait for a free cell, 0 to wait for a full cell
+ */
+static void wait_on(int *word, int *waiters, buffer_t *buffer, int putting) {
+    int i;
+    for (i = 0; i < SPIN_COUNT; ++i) {
+        size_t pos = __atomic_load_n(putting ? &buffer->in : &buffer->out, __ATOMIC_RELAXED);
+        buffer_cell_t *cell = &buffer->cells[pos % buffer->size];
+        if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) == (putting ? FREE(pos) : FULL(pos))) {
+            return;
+        }
+        sched_yield();
+    }
+
+    int value = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+    size_t pos = __atomic_load_n(putting ? &buffer->in : &buffer->out, __ATOMIC_SEQ_CST);
+    buffer_cell_t *cell = &buffer->cells[pos % buffer->size];
+    if (__atomic_load_n(&cell->sequence, __ATOMIC_SEQ_CST) != (putting ? FREE(pos) : FULL(pos))) {
+        syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+    }
+    __atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Wakes the sleepers of a futex word, if there are any.
+ * @param word futex word
+ * @param waiters sleeper count of the word
+ */
+static void wake_up(int *word, int *waiters) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST) > 0) {
+        __atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 0x7fffffff, NULL, NULL, 0);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef BBM342_EXP2_BUFFER_H
+#define BBM342_EXP2_BUFFER_H
+
+#include <stddef.h>
+
+#define CACHE_LINE 64
+
+/* Slot of the ring. Its sequence tells whether it is free or full for a
+ * position: free for position p when it equals 2p, full when it equals 2p + 1. */
+typedef struct buffer_cell {
+    size_t sequence;
+    void *item;
+} buffer_cell_t;
+
+/* Bounded multi-producer multi-consumer ring of file jobs. NULL items are
+ * sentinels and a batch read stops at them. */
+typedef struct buffer {
+    buffer_cell_t *cells;
+    size_t size;
+    char pad0[CACHE_LINE];
+    size_t in;              /* next position to put */
+    char pad1[CACHE_LINE];
+    size_t out;             /* next position to read */
+    char pad2[CACHE_LINE];
+    int not_empty;          /* futex words, changed after puts and reads */
+    int not_full;
+    int empty_waiters;      /* sleeping consumers */
+    int full_waiters;       /* sleeping producers */
+} buffer_t;
+
+buffer_t* create_buffer(int size);
+void put_buffer(buffer_t *buffer, void *value);
+void *read_buffer(buffer_t *buffer);
+void put_many(buffer_t *buffer, void **values, int count);
+int get_many(buffer_t *buffer, void **values, int count);
+int try_get_many(buffer_t *buffer, void **values, int count);
+void destroy_buffer(buffer_t *buffer);
+
+#endif
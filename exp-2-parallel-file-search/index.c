@@ -0,0 +1,574 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * Trigram index of the search path
+ *
+ * The index file lists the txt files of the last search with their size
+ * and modification time, and for every lower cased trigram the files that
+ * contain it. A file can match a query only if it has every trigram of the
+ * query, so files that are unchanged since the last search are sent to the
+ * minions only if their postings say so. New and changed files are read
+ * once for their trigrams, and the index is written again with the files of
+ * this search when anything has changed. Queries shorter than three bytes
+ * match every file. The index file is mapped, not read.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "index.h"
+
+#define TRIGRAMS    (1 << 24)
+
+static unsigned char fold_table[256];
+
+static int map_index(index_t *index, const char *path);
+static void find_candidates(index_search_t *search);
+static int find_file(const index_t *index, const char *path);
+static const index_trigram_t *find_trigram(const index_t *index, unsigned int trigram);
+static int read_trigrams(const char *path, trigram_set_t *set);
+static int has_query(const index_search_t *search, const trigram_set_t *set);
+static size_t add_entry(index_search_t *search, const char *path, const struct stat *file_stat);
+static void write_index(index_search_t *search);
+static int compare_entries(const void *a, const void *b);
+static int compare_pairs(const void *a, const void *b);
+
+/**
+ * Maps the index of the last search, if there is a valid one, and finds
+ * the files of it that may match the queries.
+ * @param search pointer of an index_search_t
+ * @param path index file
+ * @param queries search queries
+ * @param query_count query count
+ */
+void open_index_search(index_search_t *search, const char *path, char **queries, int query_count) {
+    int c, i;
+    for (c = 0; c < 256; ++c) {
+        fold_table[c] = (unsigned char) tolower(c);
+    }
+
+    memset(search, 0, sizeof(index_search_t));
+    search->path = path;
+    search->query_count = query_count;
+    pthread_mutex_init(&search->lock, NULL);
+
+    /* distinct trigrams of the queries */
+    size_t total = 0;
+    for (i = 0; i < query_count; ++i) {
+        total += strlen(queries[i]);
+    }
+    search->query_trigrams = (unsigned int *) malloc(sizeof(unsigned int) * (total + 1));
+    search->query_lengths = (int *) malloc(sizeof(int) * query_count);
+    unsigned int *trigrams = search->query_trigrams;
+    for (i = 0; i < query_count; ++i) {
+        const unsigned char *query = (const unsigned char *) queries[i];
+        size_t j, length = strlen(queries[i]);
+        int count = 0, k;
+        for (j = 2; j < length; ++j) {
+            unsigned int trigram = (unsigned int) fold_table[query[j - 2]] << 16 |
+                                   (unsigned int) fold_table[query[j - 1]] << 8 | fold_table[query[j]];
+            for (k = 0; k < count && trigrams[k] != trigram; ++k) {
+            }
+            if (k == count) {
+                trigrams[count++] = trigram;
+            }
+        }
+        search->query_lengths[i] = length < 3 ? -1 : count;
+        trigrams += count;
+    }
+
+    if (map_index(&search->old, path) < 0) {
+        memset(&search->old, 0, sizeof(index_t));
+    }
+    unsigned int files = search->old.files_count;
+    search->candidates = (unsigned char *) calloc(files + 1, 1);
+    search->kept = (int *) malloc(sizeof(int) * (files + 1));
+    for (i = 0; i < (int) files; ++i) {
+        search->kept[i] = -1;
+    }
+    find_candidates(search);
+}
+
+/**
+ * Tells whether a found file has to be searched. Unchanged files are looked
+ * up in the old index; others are read for their trigrams and added to the
+ * next index. Called from the walker threads.
+ * @param search pointer of an index_search_t
+ * @param path path of the file
+ * @param file_stat status of the file, NULL if it cannot be taken
+ * @param set trigram set of the calling thread
+ * @return 1 if the file may match, 0 otherwise
+ */
+int is_candidate(index_search_t *search, const char *path, const struct stat *file_stat, trigram_set_t *set) {
+    if (file_stat == NULL || !S_ISREG(file_stat->st_mode)) {
+        return 1; /* the minion reports it */
+    }
+
+    int id = find_file(&search->old, path);
+    if (id >= 0) {
+        const index_file_t *file = &search->old.files[id];
+        if (file->size == (long long) file_stat->st_size && file->mtime == (long long) file_stat->st_mtim.tv_sec &&
+            file->mtime_nsec == (long long) file_stat->st_mtim.tv_nsec) {
+            pthread_mutex_lock(&search->lock);
+            if (search->kept[id] < 0) {
+                search->kept[id] = (int) add_entry(search, search->old.strings + file->path, file_stat);
+            }
+            pthread_mutex_unlock(&search->lock);
+            return search->candidates[id];
+        }
+    }
+
+    if (read_trigrams(path, set) < 0) {
+        return 1;
+    }
+    unsigned int *trigrams = (unsigned int *) malloc(sizeof(unsigned int) * (set->count + 1));
+    memcpy(trigrams, set->list, sizeof(unsigned int) * set->count);
+    int candidate = has_query(search, set);
+
+    pthread_mutex_lock(&search->lock);
+    char *copy = strdup(path);
+    size_t entry = add_entry(search, copy, file_stat);
+    search->entries[entry].trigrams = trigrams;
+    search->entries[entry].count = set->count;
+    search->changed = 1;
+    pthread_mutex_unlock(&search->lock);
+
+    size_t i;
+    for (i = 0; i < set->count; ++i) {
+        set->bits[set->list[i] >> 3] = 0;
+    }
+    set->count = 0;
+    return candidate;
+}
+
+/**
+ * Writes the next index if a file is added, changed or gone, and
+ * deallocates the search.
+ * @param search pointer of an index_search_t
+ */
+void close_index_search(index_search_t *search) {
+    unsigned int i, kept = 0;
+    for (i = 0; i < search->old.files_count; ++i) {
+        kept += search->kept[i] >= 0;
+    }
+    if (search->changed || kept != search->old.files_count) {
+        write_index(search);
+    }
+
+    size_t e;
+    for (e = 0; e < search->entries_count; ++e) {
+        if (search->entries[e].trigrams != NULL) {
+            free(search->entries[e].trigrams);
+            free((char *) search->entries[e].path);
+        }
+    }
+    free(search->entries);
+    free(search->kept);
+    free(search->candidates);
+    free(search->query_trigrams);
+    free(search->query_lengths);
+    if (search->old.data != NULL) {
+        munmap(search->old.data, search->old.size);
+    }
+    pthread_mutex_destroy(&search->lock);
+}
+
+/**
+ * Initializes an empty trigram set, its bitmap is allocated when needed.
+ * @param set pointer of an trigram_set_t
+ */
+void init_trigram_set(trigram_set_t *set) {
+    memset(set, 0, sizeof(trigram_set_t));
+}
+
+/**
+ * Deallocates a trigram set
+ * @param set pointer of an trigram_set_t
+ */
+void free_trigram_set(trigram_set_t *set) {
+    free(set->bits);
+    free(set->list);
+    init_trigram_set(set);
+}
+
+/**
+ * Maps an index file and checks its layout.
+ * @param index destination
+ * @param path index file
+ * @return 0 on success, -1 if there is no valid index
+ */
+static int map_index(index_t *index, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0 || (size_t) file_stat.st_size < sizeof(index_header_t)) {
+        close(fd);
+        return -1;
+    }
+    index->size = (size_t) file_stat.st_size;
+    index->data = mmap(NULL, index->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (index->data == MAP_FAILED) {
+        return -1;
+    }
+
+    const index_header_t *header = (const index_header_t *) index->data;
+    size_t expected = sizeof(index_header_t) + sizeof(index_file_t) * header->files +
+                      sizeof(index_trigram_t) * header->trigrams +
+                      sizeof(unsigned int) * header->postings + header->strings;
+    if (memcmp(header->magic, INDEX_MAGIC, 4) != 0 || header->version != INDEX_VERSION ||
+        expected != index->size) {
+        munmap(index->data, index->size);
+        return -1;
+    }
+    index->files_count = header->files;
+    index->trigrams_count = header->trigrams;
+    index->files = (const index_file_t *) (header + 1);
+    index->trigrams = (const index_trigram_t *) (index->files + header->files);
+    index->postings = (const unsigned int *) (index->trigrams + header->trigrams);
+    index->strings = (const char *) (index->postings + header->postings);
+
+    /* a broken index must not take the search out of the mapping */
+    unsigned int i;
+    for (i = 0; i < header->files; ++i) {
+        if (index->files[i].path >= header->strings) {
+            munmap(index->data, index->size);
+            return -1;
+        }
+    }
+    for (i = 0; i < header->trigrams; ++i) {
+        const index_trigram_t *trigram = &index->trigrams[i];
+        if (trigram->first > header->postings || trigram->count > header->postings - trigram->first) {
+            munmap(index->data, index->size);
+            return -1;
+        }
+    }
+    unsigned long long p;
+    for (p = 0; p < header->postings; ++p) {
+        if (index->postings[p] >= header->files) {
+            munmap(index->data, index->size);
+            return -1;
+        }
+    }
+    if (header->strings == 0 || index->strings[header->strings - 1] != '\0') {
+        if (header->files > 0) {
+            munmap(index->data, index->size);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Marks the old files that have every trigram of at least one query.
+ * @param search pointer of an index_search_t
+ */
+static void find_candidates(index_search_t *search) {
+    const index_t *index = &search->old;
+    if (index->files_count == 0) {
+        return;
+    }
+    int *hits = (int *) malloc(sizeof(int) * index->files_count);
+    const unsigned int *trigrams = search->query_trigrams;
+    int i, k;
+    for (i = 0; i < search->query_count; ++i) {
+        int count = search->query_lengths[i];
+        if (count < 0) {
+            memset(search->candidates, 1, index->files_count); /* too short to filter */
+            break;
+        }
+
+        memset(hits, 0, sizeof(int) * index->files_count);
+        for (k = 0; k < count; ++k) {
+            const index_trigram_t *trigram = find_trigram(index, trigrams[k]);
+            if (trigram == NULL) {
+                break; /* no file has it */
+            }
+            const unsigned int *posting = index->postings + trigram->first;
+            unsigned int p;
+            for (p = 0; p < trigram->count; ++p) {
+                hits[posting[p]]++;
+            }
+        }
+        if (k == count) {
+            unsigned int f;
+            for (f = 0; f < index->files_count; ++f) {
+                search->candidates[f] |= hits[f] == count;
+            }
+        }
+        trigrams += count;
+    }
+    free(hits);
+}
+
+/**
+ * Binary search of a path in the files of an index
+ * @param index pointer of an index_t
+ * @param path path of the file
+ * @return file number, -1 if it is not in the index
+ */
+static int find_file(const index_t *index, const char *path) {
+    int low = 0, high = (int) index->files_count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        int order = strcmp(index->strings + index->files[middle].path, path);
+        if (order == 0) {
+            return middle;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Binary search of a trigram in an index
+ * @param index pointer of an index_t
+ * @param trigram lower cased trigram
+ * @return the trigram and its postings, NULL if no file has it
+ */
+static const index_trigram_t *find_trigram(const index_t *index, unsigned int trigram) {
+    int low = 0, high = (int) index->trigrams_count - 1;
+    while (low <= high) {
+        int middle = low + (high - low) / 2;
+        if (index->trigrams[middle].trigram == trigram) {
+            return &index->trigrams[middle];
+        }
+        if (index->trigrams[middle].trigram < trigram) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Collects the distinct lower cased trigrams of a file.
+ * @param path path of the file
+ * @param set empty trigram set, filled
+ * @return 0 on success, -1 on error
+ */
+static int read_trigrams(const char *path, trigram_set_t *set) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0) {
+        close(fd);
+        return -1;
+    }
+    size_t length = (size_t) file_stat.st_size;
+    if (length < 3) {
+        close(fd);
+        return 0;
+    }
+    const unsigned char *data = (const unsigned char *) mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    madvise((void *) data, length, MADV_SEQUENTIAL);
+
+    if (set->bits == NULL) {
+        set->bits = (unsigned char *) calloc(TRIGRAMS / 8, 1);
+    }
+    unsigned int trigram = (unsigned int) fold_table[data[0]] << 8 | fold_table[data[1]];
+    size_t i;
+    for (i = 2; i < length; ++i) {
+        trigram = (trigram << 8 | fold_table[data[i]]) & (TRIGRAMS - 1);
+        unsigned char bit = (unsigned char) (1 << (trigram & 7));
+        if (!(set->bits[trigram >> 3] & bit)) {
+            set->bits[trigram >> 3] |= bit;
+            if (set->count == set->capacity) {
+                set->capacity = set->capacity ? set->capacity * 2 : 4096;
+                set->list = (unsigned int *) realloc(set->list, sizeof(unsigned int) * set->capacity);
+            }
+            set->list[set->count++] = trigram;
+        }
+    }
+    munmap((void *) data, length);
+    return 0;
+}
+
+/**
+ * Tells whether a trigram set has every trigram of at least one query.
+ * @param search pointer of an index_search_t
+ * @param set trigrams of a file
+ * @return 1 if the file may match, 0 otherwise
+ */
+static int has_query(const index_search_t *search, const trigram_set_t *set) {
+    const unsigned int *trigrams = search->query_trigrams;
+    int i, k;
+    for (i = 0; i < search->query_count; ++i) {
+        int count = search->query_lengths[i];
+        if (count < 0) {
+            return 1;
+        }
+        for (k = 0; k < count && set->bits != NULL &&
+                    (set->bits[trigrams[k] >> 3] & (1 << (trigrams[k] & 7))); ++k) {
+        }
+        if (k == count) {
+            return 1;
+        }
+        trigrams += count;
+    }
+    return 0;
+}
+
+/**
+ * Adds a file to the next index. Called with the lock of the search.
+ * @param search pointer of an index_search_t
+ * @param path path of the file, kept
+ * @param file_stat status of the file
+ * @return entry number
+ */
+static size_t add_entry(index_search_t *search, const char *path, const struct stat *file_stat) {
+    if (search->entries_count == search->entries_capacity) {
+        search->entries_capacity = search->entries_capacity ? search->entries_capacity * 2 : 256;
+        search->entries = (index_entry_t *) realloc(search->entries,
+                                                    sizeof(index_entry_t) * search->entries_capacity);
+    }
+    index_entry_t *entry = &search->entries[search->entries_count];
+    entry->path = path;
+    entry->size = (long long) file_stat->st_size;
+    entry->mtime = (long long) file_stat->st_mtim.tv_sec;
+    entry->mtime_nsec = (long long) file_stat->st_mtim.tv_nsec;
+    entry->trigrams = NULL;
+    entry->count = 0;
+    return search->entries_count++;
+}
+
+/**
+ * Writes the files of this search as the next index. Postings of the kept
+ * files are taken from the old index. The file is written next to the
+ * index and renamed over it.
+ * @param search pointer of an index_search_t
+ */
+static void write_index(index_search_t *search) {
+    const index_t *old = &search->old;
+    size_t n = search->entries_count, i;
+
+    /* files in path order */
+    index_entry_t **order = (index_entry_t **) malloc(sizeof(index_entry_t *) * (n + 1));
+    unsigned int *number = (unsigned int *) malloc(sizeof(unsigned int) * (n + 1));
+    for (i = 0; i < n; ++i) {
+        order[i] = &search->entries[i];
+    }
+    qsort(order, n, sizeof(index_entry_t *), compare_entries);
+    for (i = 0; i < n; ++i) {
+        number[order[i] - search->entries] = (unsigned int) i;
+    }
+
+    /* (trigram, file) pairs, sorted */
+    size_t pairs_count = 0, capacity = 0;
+    for (i = 0; i < n; ++i) {
+        capacity += search->entries[i].count;
+    }
+    if (old->files_count > 0) {
+        capacity += (size_t) ((const index_header_t *) old->data)->postings;
+    }
+    unsigned long long *pairs = (unsigned long long *) malloc(sizeof(unsigned long long) * (capacity + 1));
+    unsigned int t, p;
+    for (t = 0; t < old->trigrams_count; ++t) {
+        const index_trigram_t *trigram = &old->trigrams[t];
+        for (p = 0; p < trigram->count; ++p) {
+            int entry = search->kept[old->postings[trigram->first + p]];
+            if (entry >= 0) {
+                pairs[pairs_count++] = (unsigned long long) trigram->trigram << 32 | number[entry];
+            }
+        }
+    }
+    for (i = 0; i < n; ++i) {
+        size_t k;
+        for (k = 0; k < search->entries[i].count; ++k) {
+            pairs[pairs_count++] = (unsigned long long) search->entries[i].trigrams[k] << 32 | number[i];
+        }
+    }
+    qsort(pairs, pairs_count, sizeof(unsigned long long), compare_pairs);
+
+    index_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, 4);
+    header.version = INDEX_VERSION;
+    header.files = (unsigned int) n;
+    header.postings = pairs_count;
+
+    index_file_t *files = (index_file_t *) malloc(sizeof(index_file_t) * (n + 1));
+    for (i = 0; i < n; ++i) {
+        files[i].path = header.strings;
+        files[i].size = order[i]->size;
+        files[i].mtime = order[i]->mtime;
+        files[i].mtime_nsec = order[i]->mtime_nsec;
+        header.strings += strlen(order[i]->path) + 1;
+    }
+    index_trigram_t *trigrams = (index_trigram_t *) malloc(sizeof(index_trigram_t) * (pairs_count + 1));
+    unsigned int *postings = (unsigned int *) malloc(sizeof(unsigned int) * (pairs_count + 1));
+    for (i = 0; i < pairs_count; ++i) {
+        unsigned int trigram = (unsigned int) (pairs[i] >> 32);
+        if (header.trigrams == 0 || trigrams[header.trigrams - 1].trigram != trigram) {
+            trigrams[header.trigrams].trigram = trigram;
+            trigrams[header.trigrams].count = 0;
+            trigrams[header.trigrams].first = i;
+            header.trigrams++;
+        }
+        trigrams[header.trigrams - 1].count++;
+        postings[i] = (unsigned int) pairs[i];
+    }
+
+    char *temporary = (char *) malloc(strlen(search->path) + 5);
+    sprintf(temporary, "%s.tmp", search->path);
+    FILE *file = fopen(temporary, "wb");
+    int written = file != NULL &&
+                  fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(files, sizeof(index_file_t), n, file) == n &&
+                  fwrite(trigrams, sizeof(index_trigram_t), header.trigrams, file) == header.trigrams &&
+                  fwrite(postings, sizeof(unsigned int), pairs_count, file) == pairs_count;
+    for (i = 0; written && i < n; ++i) {
+        written = fwrite(order[i]->path, strlen(order[i]->path) + 1, 1, file) == 1;
+    }
+    if (file != NULL && fclose(file) != 0) {
+        written = 0;
+    }
+    if (!written || rename(temporary, search->path) < 0) {
+        fprintf(stderr, "Cannot write the index %s.\n", search->path);
+        unlink(temporary);
+    }
+
+    free(temporary);
+    free(postings);
+    free(trigrams);
+    free(files);
+    free(pairs);
+    free(number);
+    free(order);
+}
+
+/**
+ * Orders entries of the next index by path
+ */
+static int compare_entries(const void *a, const void *b) {
+    return strcmp((*(index_entry_t * const *) a)->path, (*(index_entry_t * const *) b)->path);
+}
+
+/**
+ * Orders (trigram, file) pairs
+ */
+static int compare_pairs(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *) a, y = *(const unsigned long long *) b;
+    return x < y ? -1 : x > y;
+}
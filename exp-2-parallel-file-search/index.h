@@ -0,0 +1,92 @@
+#ifndef BBM342_EXP2_INDEX_H
+#define BBM342_EXP2_INDEX_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC     "BBMI"
+#define INDEX_VERSION   1
+
+/* Header of an index file. It is followed by the files sorted by path, the
+ * trigrams sorted by value, the postings of every trigram (file numbers in
+ * order) and the paths. Numbers are native. */
+typedef struct index_header {
+    char magic[4];
+    int version;
+    unsigned int files;
+    unsigned int trigrams;
+    unsigned long long postings;
+    unsigned long long strings;     /* bytes of the paths */
+} index_header_t;
+
+/* Indexed file, stale when its size or modification time changes */
+typedef struct index_file {
+    unsigned long long path;        /* offset of the path */
+    long long size;
+    long long mtime;
+    long long mtime_nsec;
+} index_file_t;
+
+/* Lower cased trigram and its postings */
+typedef struct index_trigram {
+    unsigned int trigram;
+    unsigned int count;
+    unsigned long long first;       /* index of its first posting */
+} index_trigram_t;
+
+/* A mapped index file */
+typedef struct index {
+    void *data;
+    size_t size;
+    unsigned int files_count;
+    unsigned int trigrams_count;
+    const index_file_t *files;
+    const index_trigram_t *trigrams;
+    const unsigned int *postings;
+    const char *strings;
+} index_t;
+
+/* Distinct trigrams of a file, a bitmap of every trigram and their list */
+typedef struct trigram_set {
+    unsigned char *bits;
+    unsigned int *list;
+    size_t count;
+    size_t capacity;
+} trigram_set_t;
+
+/* File of the next index */
+typedef struct index_entry {
+    const char *path;
+    long long size;
+    long long mtime;
+    long long mtime_nsec;
+    unsigned int *trigrams;         /* NULL if it is in the old index */
+    size_t count;
+} index_entry_t;
+
+/* Lookup of the files found by a search in the index of the last one, and
+ * the index that replaces it */
+typedef struct index_search {
+    const char *path;               /* index file */
+    index_t old;
+    int query_count;
+    unsigned int *query_trigrams;   /* distinct trigrams of every query */
+    int *query_lengths;             /* their counts, -1 if a query is too short */
+    unsigned char *candidates;      /* per old file, 1 if it may match */
+    int *kept;                      /* per old file, its entry or -1 */
+    pthread_mutex_t lock;           /* the entries and kept */
+    index_entry_t *entries;
+    size_t entries_count;
+    size_t entries_capacity;
+    int changed;
+} index_search_t;
+
+void open_index_search(index_search_t *search, const char *path, char **queries, int query_count);
+int is_candidate(index_search_t *search, const char *path, const struct stat *file_stat, trigram_set_t *set);
+void close_index_search(index_search_t *search);
+
+void init_trigram_set(trigram_set_t *set);
+void free_trigram_set(trigram_set_t *set);
+
+#endif
@@ -0,0 +1,231 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * File jobs and split files
+ *
+ * The file buffer carries jobs. A job is a whole file, or a byte range of a
+ * file that is larger than the range size, so that the minions share the
+ * work of a single large file. The matches of a range can be written only
+ * when the newline counts of the ranges before it are known, so the ranges
+ * of a file are committed to the log in order: the controller that finishes
+ * the next range writes it and every finished range after it, and matches
+ * of the range at the head go to the log as soon as they come.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobs.h"
+
+#define PUT_JOBS 64 /* range jobs put to the buffer at once */
+
+static void free_split(file_split_t *split);
+
+/**
+ * Creates the job of a whole file
+ * @param path path of the file, owned by the job
+ * @return pointer of an file_job_t
+ */
+file_job_t *create_file_job(char *path) {
+    file_job_t *job = (file_job_t *) calloc(1, sizeof(file_job_t));
+    job->path = path;
+    job->length = -1;
+    job->file_size = -1;
+    return job;
+}
+
+/**
+ * Splits a file into ranges of range_size bytes and puts their jobs to the
+ * buffer in order.
+ * @param buffer pointer of an buffer_t
+ * @param path path of the file, owned by the split
+ * @param size byte count of the file
+ * @param range_size byte count of a range
+ */
+void put_split_file(buffer_t *buffer, char *path, long long size, long long range_size) {
+    file_split_t *split = create_split(path);
+    put_ranges(buffer, split, size, range_size, 0);
+    close_split(split);
+}
+
+/**
+ * Creates an open split without ranges
+ * @param path path of the file, owned by the split
+ * @return pointer of an file_split_t
+ */
+file_split_t *create_split(char *path) {
+    file_split_t *split = (file_split_t *) calloc(1, sizeof(file_split_t));
+    pthread_mutex_init(&split->lock, NULL);
+    split->path = path;
+    split->open = 1;
+    return split;
+}
+
+/**
+ * Puts the bytes of a file from the end of its last range up to size as
+ * ranges of range_size bytes (one range if it is not positive). The first
+ * of them may be an append to a searched file; its matches can start in
+ * the bytes before it, see minion.c.
+ * @param buffer pointer of an buffer_t
+ * @param split pointer of an file_split_t
+ * @param size byte count of the file
+ * @param range_size byte count of a range
+ * @param appended 1 if the bytes are appended to a searched file
+ */
+void put_ranges(buffer_t *buffer, file_split_t *split, long long size, long long range_size, int appended) {
+    file_job_t *jobs[PUT_JOBS];
+    int count = 0;
+    while (1) {
+        pthread_mutex_lock(&split->lock);
+        long long offset = split->size;
+        if (offset >= size) {
+            pthread_mutex_unlock(&split->lock);
+            break;
+        }
+        if (split->ranges - split->first == split->capacity) {
+            /* drop committed ranges, then grow */
+            int committed = split->committed - split->first;
+            memmove(split->results, split->results + committed,
+                    (size_t) (split->ranges - split->committed) * sizeof(range_results_t));
+            split->first = split->committed;
+            if (split->ranges - split->first == split->capacity) {
+                split->capacity = split->capacity ? split->capacity * 2 : 4;
+                split->results = (range_results_t *) realloc(split->results,
+                                                             split->capacity * sizeof(range_results_t));
+            }
+        }
+        file_job_t *job = (file_job_t *) malloc(sizeof(file_job_t));
+        job->path = split->path;
+        job->offset = offset;
+        job->length = range_size > 0 && size - offset > range_size ? range_size : size - offset;
+        job->split = split;
+        job->index = split->ranges++;
+        job->file_size = size;
+        job->appended = appended && offset > 0;
+        memset(&split->results[job->index - split->first], 0, sizeof(range_results_t));
+        split->size = offset + job->length;
+        pthread_mutex_unlock(&split->lock);
+
+        appended = 0;
+        jobs[count++] = job;
+        if (count == PUT_JOBS) {
+            put_many(buffer, (void **) jobs, count); /* not under the lock, controllers need it */
+            count = 0;
+        }
+    }
+    put_many(buffer, (void **) jobs, count);
+}
+
+/**
+ * Tells that no more ranges come to a split. It is freed with its last
+ * committed range.
+ * @param split pointer of an file_split_t
+ */
+void close_split(file_split_t *split) {
+    pthread_mutex_lock(&split->lock);
+    split->open = 0;
+    int finished = split->committed == split->ranges;
+    pthread_mutex_unlock(&split->lock);
+    if (finished) {
+        free_split(split);
+    }
+}
+
+/**
+ * Takes a result frame of a minion: log lines go to the log buffer of the
+ * controller, and matches go to the split of their range.
+ * @param job range job of the matches, unused for log lines
+ * @param id minion's id
+ * @param frame frame header
+ * @param data bytes of the frame
+ * @param log log buffer of the controller
+ */
+void add_results(file_job_t *job, const char *id, const result_frame_t *frame, const char *data,
+                 log_buffer_t *log) {
+    if (frame->kind == RESULT_LINES) {
+        append_log(log, data, frame->length);
+    } else {
+        add_range_results(job, id, (const range_match_t *) data, frame->length / sizeof(range_match_t),
+                          frame->kind == RESULT_RANGE_END, frame->newlines, log);
+    }
+}
+
+/**
+ * Takes matches of a range from its minion. They are written to the log if
+ * every range before is committed and kept otherwise. The last matches of a
+ * range commit it and every finished range after it; the job is freed, and
+ * a closed split with the last of its ranges.
+ * @param job range job
+ * @param id minion process' id
+ * @param matches matches of the range, lines counted from the range start
+ * @param count match count
+ * @param end 1 if the range is finished
+ * @param newlines newline count of the range, if it is finished
+ * @param log log buffer of the controller
+ */
+void add_range_results(file_job_t *job, const char *id, const range_match_t *matches, size_t count,
+                       int end, long long newlines, log_buffer_t *log) {
+    file_split_t *split = job->split;
+
+    pthread_mutex_lock(&split->lock);
+    range_results_t *results = &split->results[job->index - split->first];
+    results->id = id;
+    int written = 0;
+    if (job->index == split->committed) {
+        add_log_matches(log, id, split->path, split->newlines, matches, count);
+        written = count > 0;
+    } else if (count > 0) {
+        if (results->count + count > results->capacity) {
+            results->capacity = (results->count + count) * 2;
+            results->matches = (range_match_t *) realloc(results->matches,
+                                                         results->capacity * sizeof(range_match_t));
+        }
+        memcpy(results->matches + results->count, matches, count * sizeof(range_match_t));
+        results->count += count;
+    }
+
+    int finished = 0;
+    if (end) {
+        results->done = 1;
+        results->newlines = newlines;
+        while (split->committed < split->ranges && split->results[split->committed - split->first].done) {
+            split->newlines += split->results[split->committed - split->first].newlines;
+            split->committed++;
+            if (split->committed < split->ranges) {
+                /* the next range is the head now, its kept matches can go */
+                range_results_t *next = &split->results[split->committed - split->first];
+                add_log_matches(log, next->id, split->path, split->newlines, next->matches, next->count);
+                written |= next->count > 0;
+                free(next->matches);
+                next->matches = NULL;
+                next->count = next->capacity = 0;
+            }
+        }
+        finished = !split->open && split->committed == split->ranges;
+    }
+    if (written && !finished) {
+        flush_log(log); /* before the next range of the file, maybe by another controller */
+    }
+    pthread_mutex_unlock(&split->lock);
+
+    if (end) {
+        free(job);
+    }
+    if (finished) {
+        free_split(split);
+    }
+}
+
+/**
+ * Deallocates a split and its path
+ * @param split pointer of an file_split_t
+ */
+static void free_split(file_split_t *split) {
+    pthread_mutex_destroy(&split->lock);
+    free(split->results);
+    free(split->path);
+    free(split);
+}
@@ -0,0 +1,56 @@
+#ifndef BBM342_EXP2_JOBS_H
+#define BBM342_EXP2_JOBS_H
+
+#include <pthread.h>
+
+#include "buffer.h"
+#include "log.h"
+#include "protocol.h"
+
+/* Matches of a range that wait for the ranges before it */
+typedef struct range_results {
+    const char *id;         /* minion that searched the range */
+    range_match_t *matches;
+    size_t count;
+    size_t capacity;
+    int done;
+    long long newlines;
+} range_results_t;
+
+/* A file that is searched as several ranges. A watched file stays open and
+ * gets a range for every append. */
+typedef struct file_split {
+    pthread_mutex_t lock;
+    char *path;
+    long long size;         /* bytes put as ranges */
+    int ranges;             /* ranges put */
+    int committed;          /* ranges written to the log */
+    long long newlines;     /* newlines before the first range that is not committed */
+    int first;              /* range number of results[0] */
+    int capacity;
+    range_results_t *results;
+    int open;               /* more ranges may come */
+} file_split_t;
+
+/* Item of the file buffer: a whole file or a byte range of a large one */
+typedef struct file_job {
+    char *path;
+    long long offset;
+    long long length;       /* -1 for the whole file */
+    file_split_t *split;    /* NULL for the whole file */
+    int index;              /* range number in the split */
+    long long file_size;    /* bytes of the file searched by the range */
+    int appended;           /* the range was appended to a searched file */
+} file_job_t;
+
+file_job_t *create_file_job(char *path);
+void put_split_file(buffer_t *buffer, char *path, long long size, long long range_size);
+file_split_t *create_split(char *path);
+void put_ranges(buffer_t *buffer, file_split_t *split, long long size, long long range_size, int appended);
+void close_split(file_split_t *split);
+void add_results(file_job_t *job, const char *id, const result_frame_t *frame, const char *data,
+                 log_buffer_t *log);
+void add_range_results(file_job_t *job, const char *id, const range_match_t *matches, size_t count,
+                       int end, long long newlines, log_buffer_t *log);
+
+#endif
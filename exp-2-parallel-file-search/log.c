@@ -0,0 +1,374 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * Search log
+ *
+ * Every controller collects its log lines in its own buffer and writes it
+ * to the log with one writev when it is full or when the controller waits
+ * for work, so the log lock is taken rarely and for large writes only.
+ *
+ * In the ordered mode the log is sorted by path, line, column and query,
+ * without the minion ids, so it is the same for every run. Controllers
+ * collect their matches as records, sort them in runs of RUN_RECORDS and
+ * spill the runs to temporary files. When the search is over, the runs are
+ * merged into the log with a heap, reading one record of every run at a
+ * time, so the matches are never in memory at once.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "log.h"
+
+/* A record in a run file, its path follows it */
+typedef struct run_record {
+    size_t path_length;
+    int line;
+    int query;
+    long column;
+} run_record_t;
+
+/* Next record of a run while the runs are merged */
+typedef struct run_cursor {
+    FILE *file;
+    log_record_t record;
+    char *path;
+    size_t capacity;
+} run_cursor_t;
+
+static void spill_run(log_buffer_t *buffer);
+static void merge_runs(search_log_t *log);
+static int read_run_record(run_cursor_t *cursor);
+static void sift_down(run_cursor_t *cursors, int *heap, int count, int i);
+static int compare_records(const void *a, const void *b);
+
+/**
+ * Creates searchlog.txt and writes its header.
+ * @param log pointer of an search_log_t
+ * @param queries search queries
+ * @param query_count query count
+ * @param ordered 1 to sort the matches
+ */
+void open_log(search_log_t *log, char **queries, int query_count, int ordered) {
+    memset(log, 0, sizeof(search_log_t));
+    log->file = fopen("searchlog.txt", "w");
+    if (log->file == NULL) {
+        fprintf(stderr, "[open-log] Cannot open searchlog.txt.\n");
+        exit(EXIT_FAILURE);
+    }
+    int i;
+    fprintf(log->file, "Log File\nSearch for ");
+    for (i = 0; i < query_count; ++i) {
+        fprintf(log->file, i == 0 ? "\"%s\"" : ", \"%s\"", queries[i]);
+    }
+    fprintf(log->file, " %s\n", query_count == 1 ? "string" : "strings");
+    fprintf(log->file, "----------------------\n");
+    fflush(log->file);
+    log->fd = fileno(log->file);
+
+    log->mutex = (sem_t *) malloc(sizeof(sem_t));
+    sem_init(log->mutex, 0, 1);
+    log->queries = queries;
+    log->query_count = query_count;
+    log->ordered = ordered;
+}
+
+/**
+ * Merges the runs of the ordered mode into the log and closes it. Called
+ * when every log buffer is freed.
+ * @param log pointer of an search_log_t
+ */
+void close_log(search_log_t *log) {
+    if (log->ordered) {
+        merge_runs(log);
+    }
+    int i;
+    for (i = 0; i < log->runs_count; ++i) {
+        fclose(log->runs[i]);
+    }
+    free(log->runs);
+    sem_destroy(log->mutex);
+    free(log->mutex);
+    fclose(log->file);
+}
+
+/**
+ * Creates the log buffer of a controller.
+ * @param buffer pointer of an log_buffer_t
+ * @param log the search log
+ */
+void init_log_buffer(log_buffer_t *buffer, search_log_t *log) {
+    memset(buffer, 0, sizeof(log_buffer_t));
+    buffer->log = log;
+    if (log->ordered) {
+        buffer->records = (log_record_t *) malloc(RUN_RECORDS * sizeof(log_record_t));
+        buffer->paths = (char *) malloc(RUN_PATHS);
+    } else {
+        buffer->data = (char *) malloc(LOG_BUFFER_SIZE);
+    }
+}
+
+/**
+ * Writes the lines of a log buffer, or spills its last run, and frees it.
+ * @param buffer pointer of an log_buffer_t
+ */
+void free_log_buffer(log_buffer_t *buffer) {
+    if (buffer->log->ordered) {
+        spill_run(buffer);
+    } else {
+        flush_log(buffer);
+    }
+    free(buffer->data);
+    free(buffer->records);
+    free(buffer->paths);
+}
+
+/**
+ * Appends log lines to a log buffer. If they do not fit, the buffer and
+ * the lines are written at once.
+ * @param buffer pointer of an log_buffer_t
+ * @param lines log lines
+ * @param length byte count of the lines
+ */
+void append_log(log_buffer_t *buffer, const char *lines, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (length > LOG_BUFFER_SIZE - buffer->length) {
+        struct iovec iov[2];
+        iov[0].iov_base = buffer->data;
+        iov[0].iov_len = buffer->length;
+        iov[1].iov_base = (void *) lines;
+        iov[1].iov_len = length;
+        sem_wait(buffer->log->mutex);
+        writev_full(buffer->log->fd, iov, 2);
+        sem_post(buffer->log->mutex);
+        buffer->length = 0;
+        return;
+    }
+    memcpy(buffer->data + buffer->length, lines, length);
+    buffer->length += length;
+}
+
+/**
+ * Adds matches of a range to a log buffer with their absolute line numbers,
+ * as log lines or as records to be sorted.
+ * @param buffer pointer of an log_buffer_t
+ * @param id minion's id
+ * @param path path of the file
+ * @param newlines newlines of the file before the range
+ * @param matches matches of the range
+ * @param count match count
+ */
+void add_log_matches(log_buffer_t *buffer, const char *id, const char *path, long long newlines,
+                     const range_match_t *matches, size_t count) {
+    search_log_t *log = buffer->log;
+    size_t i;
+    if (log->ordered) {
+        size_t path_size = strlen(path) + 1;
+        const char *copy = NULL;
+        for (i = 0; i < count; ++i) {
+            if (buffer->count == RUN_RECORDS) {
+                spill_run(buffer);
+                copy = NULL;
+            }
+            if (copy == NULL) {
+                if (RUN_PATHS - buffer->paths_length < path_size) {
+                    spill_run(buffer);
+                }
+                copy = memcpy(buffer->paths + buffer->paths_length, path, path_size);
+                buffer->paths_length += path_size;
+            }
+            log_record_t *record = &buffer->records[buffer->count++];
+            record->path = copy;
+            record->line = (int) (newlines + matches[i].line);
+            record->query = matches[i].query;
+            record->column = matches[i].column;
+        }
+        return;
+    }
+
+    for (i = 0; i < count; ++i) {
+        if (LOG_BUFFER_SIZE - buffer->length < MESSAGE_SIZE) {
+            flush_log(buffer);
+        }
+        const char *query = log->query_count == 1 ? NULL : log->queries[matches[i].query];
+        int line = (int) (newlines + matches[i].line);
+        buffer->length += (size_t) format_match(buffer->data + buffer->length, id, path, line,
+                                                matches[i].column, query);
+    }
+}
+
+/**
+ * Writes the lines of a log buffer to the log.
+ * @param buffer pointer of an log_buffer_t
+ */
+void flush_log(log_buffer_t *buffer) {
+    if (buffer->length == 0) {
+        return;
+    }
+    sem_wait(buffer->log->mutex);
+    write_full(buffer->log->fd, buffer->data, buffer->length);
+    sem_post(buffer->log->mutex);
+    buffer->length = 0;
+}
+
+/**
+ * Sorts the records of a log buffer and writes them to a new run.
+ * @param buffer pointer of an log_buffer_t
+ */
+static void spill_run(log_buffer_t *buffer) {
+    if (buffer->count > 0) {
+        qsort(buffer->records, buffer->count, sizeof(log_record_t), compare_records);
+        FILE *run = tmpfile();
+        if (run == NULL) {
+            fprintf(stderr, "[spill-run] tmpfile failed.\n");
+            exit(EXIT_FAILURE);
+        }
+        size_t i;
+        for (i = 0; i < buffer->count; ++i) {
+            run_record_t header;
+            header.path_length = strlen(buffer->records[i].path);
+            header.line = buffer->records[i].line;
+            header.query = buffer->records[i].query;
+            header.column = buffer->records[i].column;
+            fwrite(&header, sizeof(header), 1, run);
+            fwrite(buffer->records[i].path, 1, header.path_length, run);
+        }
+
+        search_log_t *log = buffer->log;
+        sem_wait(log->mutex);
+        if (log->runs_count == log->runs_capacity) {
+            log->runs_capacity = log->runs_capacity ? log->runs_capacity * 2 : 16;
+            log->runs = (FILE **) realloc(log->runs, log->runs_capacity * sizeof(FILE *));
+        }
+        log->runs[log->runs_count++] = run;
+        sem_post(log->mutex);
+    }
+    buffer->count = 0;
+    buffer->paths_length = 0;
+}
+
+/**
+ * Merges the sorted runs into the log.
+ * @param log pointer of an search_log_t
+ */
+static void merge_runs(search_log_t *log) {
+    run_cursor_t *cursors = (run_cursor_t *) calloc(log->runs_count + 1, sizeof(run_cursor_t));
+    int *heap = (int *) malloc((log->runs_count + 1) * sizeof(int));
+    int count = 0, i;
+    for (i = 0; i < log->runs_count; ++i) {
+        cursors[i].file = log->runs[i];
+        rewind(cursors[i].file);
+        if (read_run_record(&cursors[i])) {
+            heap[count++] = i;
+        }
+    }
+    for (i = count / 2 - 1; i >= 0; --i) {
+        sift_down(cursors, heap, count, i);
+    }
+
+    char *lines = (char *) malloc(LOG_BUFFER_SIZE);
+    size_t length = 0;
+    while (count > 0) {
+        run_cursor_t *cursor = &cursors[heap[0]];
+        if (LOG_BUFFER_SIZE - length < MESSAGE_SIZE) {
+            write_full(log->fd, lines, length);
+            length = 0;
+        }
+        const char *query = log->query_count == 1 ? NULL : log->queries[cursor->record.query];
+        length += (size_t) format_match(lines + length, NULL, cursor->record.path, cursor->record.line,
+                                        cursor->record.column, query);
+        if (!read_run_record(cursor)) {
+            heap[0] = heap[--count];
+        }
+        sift_down(cursors, heap, count, 0);
+    }
+    write_full(log->fd, lines, length);
+
+    free(lines);
+    for (i = 0; i < log->runs_count; ++i) {
+        free(cursors[i].path);
+    }
+    free(heap);
+    free(cursors);
+}
+
+/**
+ * Reads the next record of a run.
+ * @param cursor pointer of an run_cursor_t
+ * @return 1 on success, 0 at the end of the run
+ */
+static int read_run_record(run_cursor_t *cursor) {
+    run_record_t header;
+    if (fread(&header, sizeof(header), 1, cursor->file) != 1) {
+        return 0;
+    }
+    if (header.path_length + 1 > cursor->capacity) {
+        cursor->capacity = header.path_length + 1;
+        cursor->path = (char *) realloc(cursor->path, cursor->capacity);
+    }
+    if (fread(cursor->path, 1, header.path_length, cursor->file) != header.path_length) {
+        return 0;
+    }
+    cursor->path[header.path_length] = '\0';
+    cursor->record.path = cursor->path;
+    cursor->record.line = header.line;
+    cursor->record.query = header.query;
+    cursor->record.column = header.column;
+    return 1;
+}
+
+/**
+ * Moves a run down the heap of the merge to its place.
+ * @param cursors cursors of the runs
+ * @param heap run numbers, the smallest record first
+ * @param count runs in the heap
+ * @param i position of the run
+ */
+static void sift_down(run_cursor_t *cursors, int *heap, int count, int i) {
+    while (1) {
+        int smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < count && compare_records(&cursors[heap[left]].record, &cursors[heap[smallest]].record) < 0) {
+            smallest = left;
+        }
+        if (right < count && compare_records(&cursors[heap[right]].record, &cursors[heap[smallest]].record) < 0) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        int run = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = run;
+        i = smallest;
+    }
+}
+
+/**
+ * Orders records by path, line, column and query.
+ * @param a pointer of an log_record_t
+ * @param b pointer of an log_record_t
+ * @return negative, zero or positive as a is before, same as or after b
+ */
+static int compare_records(const void *a, const void *b) {
+    const log_record_t *x = (const log_record_t *) a, *y = (const log_record_t *) b;
+    if (x->path != y->path) {
+        int order = strcmp(x->path, y->path);
+        if (order != 0) {
+            return order;
+        }
+    }
+    if (x->line != y->line) {
+        return x->line < y->line ? -1 : 1;
+    }
+    if (x->column != y->column) {
+        return x->column < y->column ? -1 : 1;
+    }
+    return x->query - y->query;
+}
@@ -0,0 +1,55 @@
+#ifndef BBM342_EXP2_LOG_H
+#define BBM342_EXP2_LOG_H
+
+#include <stdio.h>
+#include <semaphore.h>
+
+#include "protocol.h"
+
+#define LOG_BUFFER_SIZE (1 << 18)   /* bytes of log lines a thread collects */
+#define RUN_RECORDS     (1 << 16)   /* matches sorted in memory at once */
+#define RUN_PATHS       (1 << 20)   /* bytes of their paths */
+
+/* Search log shared by the controllers */
+typedef struct search_log {
+    FILE *file;
+    int fd;                 /* of the file, lines are written to it directly */
+    sem_t *mutex;           /* writes and runs */
+    char **queries;
+    int query_count;
+    int ordered;            /* matches are sorted, see merge_runs */
+    FILE **runs;            /* sorted runs of the matches */
+    int runs_count;
+    int runs_capacity;
+} search_log_t;
+
+/* A match to be sorted */
+typedef struct log_record {
+    const char *path;
+    int line;
+    int query;
+    long column;
+} log_record_t;
+
+/* Log lines of a controller that are not written yet, or its matches that
+ * are not sorted yet in the ordered mode */
+typedef struct log_buffer {
+    search_log_t *log;
+    char *data;
+    size_t length;
+    log_record_t *records;
+    size_t count;
+    char *paths;            /* paths of the records */
+    size_t paths_length;
+} log_buffer_t;
+
+void open_log(search_log_t *log, char **queries, int query_count, int ordered);
+void close_log(search_log_t *log);
+void init_log_buffer(log_buffer_t *buffer, search_log_t *log);
+void free_log_buffer(log_buffer_t *buffer);
+void append_log(log_buffer_t *buffer, const char *lines, size_t length);
+void add_log_matches(log_buffer_t *buffer, const char *id, const char *path, long long newlines,
+                     const range_match_t *matches, size_t count);
+void flush_log(log_buffer_t *buffer);
+
+#endif
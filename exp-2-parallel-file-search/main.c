@@ -8,19 +8,20 @@
  *          gcc main.c -o main -Wall -ansi -lpthread
  *          gcc minion.c -o minion -Wall -ansi -lpthread
  *
- * Run:     ./main <minion_count> <buffer_size> <search_query> <search_path>
+ * Run:     ./main [-w walkers] [-s range_size] [-x index] [-W] [-t] [-o] [-e] <minion_count> <buffer_size> <search_query>... <search_path>
  *
  * Tags: fork, exec, pipe, process, pthreads, thread, posix, unix
  * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <unistd.h>
-#include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 
 #include "main.h"
@@ -28,42 +29,100 @@
 #define READ_END 0
 #define WRITE_END 1
 
+#define DEFAULT_RANGE_SIZE (1LL << 24) /* larger files are split into ranges */
+
+
 /**
  * Main function
  * Creates the file buffer.
- * Creates minion processes and their controller threads.
+ * Creates minion processes and their controller threads, or worker threads
+ * in the threaded mode.
  * Creates the searcher thread.
  * @param argc argument count
  * @param argv argument vector
  * @return status value as integer
  */
 int main(int argc, char *argv[]) {
-    if (argc < 5) {
-        printf("Usage: %s <minion_count> <buffer_size> <search_query> <search_path>\n", argv[0]);
+    char *program = argv[0];
+    long walkers = sysconf(_SC_NPROCESSORS_ONLN);
+    long long range_size = DEFAULT_RANGE_SIZE;
+    char *index_path = NULL;
+    int watching = 0, threaded = 0, ordered = 0, regex = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "+w:s:x:Wtoe")) != -1) { /* queries may start with '-' */
+        if (opt == 'w') {
+            walkers = atoi(optarg);
+        } else if (opt == 's') {
+            range_size = atoll(optarg);
+        } else if (opt == 'x') {
+            index_path = optarg;
+        } else if (opt == 'W') {
+            watching = 1;
+        } else if (opt == 't') {
+            threaded = 1;
+        } else if (opt == 'o') {
+            ordered = 1;
+        } else if (opt == 'e') {
+            regex = 1;
+        } else {
+            optind = argc; /* print usage */
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (argc < 5 || (watching && ordered)) { /* a watch never ends, its log cannot be sorted */
+        printf("Usage: %s [-w walkers] [-s range_size] [-x index] [-W | -o] [-t] [-e] <minion_count> <buffer_size> <search_query>... <search_path>\n", program);
         return EXIT_FAILURE;
     }
     int i;
     int minion_count = atoi(argv[1]);
-    pthread_t *controller_threads = (pthread_t *) malloc(minion_count * sizeof(pthread_t));
+    char **queries = argv + 3;
+    int query_count = argc - 4;
+    char *search_path = argv[argc - 1];
+
+    /* an index is searched for the literals that every match has; it also
+     * checks the expressions before any minion compiles them */
+    char **literals = queries;
+    if (regex) {
+        literals = (char **) malloc(sizeof(char *) * query_count);
+        for (i = 0; i < query_count; ++i) {
+            literals[i] = required_literal(queries[i]);
+        }
+    }
+    pthread_t *controller_threads = (pthread_t *) malloc(minion_count * sizeof(pthread_t)); /* or workers */
 
     /* create buffer */
     buffer_t* buffer = create_buffer(atoi(argv[2]));
 
-    /* create search logs and its mutex */
-    FILE* logs = fopen("searchlog.txt", "w");
-    fprintf(logs, "Log File\nSearch for \"%s\" string\n", argv[3]);
-    fprintf(logs, "----------------------\n");
-
-    sem_t *logs_mutex = (sem_t *) malloc(sizeof(sem_t));
-    sem_init(logs_mutex, 0, 1);
+    /* create search logs, every controller collects its lines for it */
+    search_log_t log;
+    open_log(&log, queries, query_count, ordered);
+
+    worker_args_t *workers_args = NULL;
+    if (threaded) {
+        /* minions are threads of this process, no pipes and controllers */
+        workers_args = (worker_args_t *) calloc(minion_count, sizeof(worker_args_t));
+        for (i = 0; i < minion_count; ++i) {
+            workers_args[i].buffer = buffer;
+            workers_args[i].log = &log;
+            compile_matcher(&workers_args[i].matcher, queries, query_count, regex);
+            sprintf(workers_args[i].id, "%d", i + 1);
+            pthread_create(controller_threads + i, NULL, worker_routine, (void *) (workers_args + i));
+        }
+    }
 
-    for (i = 0; i < minion_count; ++i) {
-        /* create pipes */
+    for (i = 0; i < minion_count && !threaded; ++i) {
+        /* create pipes, they are not inherited by the other minions */
         int parent_pipefd[2], child_pipefd[2];
-        if (pipe(parent_pipefd) < 0 || pipe(child_pipefd)) {
+        if (pipe2(parent_pipefd, O_CLOEXEC) < 0 || pipe2(child_pipefd, O_CLOEXEC) < 0) {
             fprintf(stderr, "[create-pipes] pipe failed.\n");
             exit(EXIT_FAILURE);
         }
+        /* results come through a shared ring, the pipe from the minion only
+         * tells that it is gone */
+        controller_args_t *controller_args = calloc(1, sizeof(controller_args_t));
+        create_ring(&controller_args->ring, parent_pipefd[READ_END]);
 
         /* fork process */
         pid_t pid = fork();
@@ -80,24 +139,33 @@ int main(int argc, char *argv[]) {
 
             dup2(parent_pipefd[WRITE_END], STDOUT_FILENO);
             close(parent_pipefd[WRITE_END]);
+            pass_ring(&controller_args->ring);
 
-            char id[5];
+            char id[12];
             sprintf(id, "%d", i + 1);
-            /* pass its id and search query */
-            char *minion_argv[4] = { "./minion", id, argv[3], NULL };
+            /* pass its id and search queries */
+            char **minion_argv = (char **) malloc(sizeof(char *) * (query_count + 4));
+            minion_argv[0] = "./minion";
+            if (regex) {
+                minion_argv[1] = "-e";
+            }
+            minion_argv[regex + 1] = id;
+            memcpy(minion_argv + regex + 2, queries, sizeof(char *) * query_count);
+            minion_argv[regex + query_count + 2] = NULL;
             if (execvp(minion_argv[0], minion_argv) < 0) {
                 fprintf(stderr, "[minion-process] execvp failed.\n");
                 exit(EXIT_FAILURE);
             }
         }
 
+        close(child_pipefd[READ_END]);
+        close(parent_pipefd[WRITE_END]);
+
         /* create control thread */
-        controller_args_t *controller_args = malloc(sizeof(controller_args_t));
         controller_args->buffer = buffer;
-        controller_args->read_end = parent_pipefd[READ_END];
         controller_args->write_end = child_pipefd[WRITE_END];
-        controller_args->logs = logs;
-        controller_args->logs_mutex = logs_mutex;
+        controller_args->log = &log;
+        sprintf(controller_args->id, "%d", i + 1);
         pthread_create(controller_threads + i, NULL, controller_routine, (void *) controller_args);
     }
 
@@ -107,8 +175,15 @@ int main(int argc, char *argv[]) {
     pthread_t searcher_thread;
     searcher_args_t *searcher_args = malloc(sizeof(searcher_args_t));
     searcher_args->buffer = buffer;
-    searcher_args->path = argv[4];
+    searcher_args->path = search_path;
     searcher_args->minion_count = minion_count;
+    searcher_args->walkers = walkers > 0 ? (int) walkers : 1;
+    searcher_args->range_size = range_size;
+    searcher_args->index_path = index_path;
+    searcher_args->watch = watching ? (watch_t *) malloc(sizeof(watch_t)) : NULL;
+    searcher_args->ordered = ordered;
+    searcher_args->queries = literals;
+    searcher_args->query_count = query_count;
     pthread_create(&searcher_thread, NULL, searcher_routine, (void *) searcher_args);
 
     /* join threads */
@@ -117,204 +192,303 @@ int main(int argc, char *argv[]) {
         pthread_join(controller_threads[i], NULL);
     }
 
+    if (threaded) {
+        for (i = 0; i < minion_count; ++i) {
+            free_matcher(&workers_args[i].matcher);
+        }
+        free(workers_args);
+    }
+    if (regex) {
+        for (i = 0; i < query_count; ++i) {
+            free(literals[i]);
+        }
+        free(literals);
+    }
+    free(searcher_args->watch);
     free(searcher_args);
-    free(logs_mutex);
     destroy_buffer(buffer);
     free(controller_threads);
-    fclose(logs);
+    close_log(&log); /* merges the sorted runs */
 
     return EXIT_SUCCESS;
 }
 
 /**
  * Subroutine for the searcher thread.
- * It iterates over the given path and searches txt files in it.
- * It puts found txt files to the buffer.
+ * It walks the given path with a pool of walker threads and puts found txt
+ * files to the buffer. With an index, only the files that may match are
+ * put, and the index is updated after the walk. In watch mode it watches
+ * the tree before the walk and searches its changes after it, forever.
  * @param args pointer of an searcher_args_t. Please see main.h
  * @return
  */
 void* searcher_routine(void* args) {
     searcher_args_t *searcher_args = (searcher_args_t *) args;
-    search_for_txt(searcher_args->path, searcher_args->buffer);
+    index_search_t index;
+    searcher_args->index = NULL;
+    if (searcher_args->index_path != NULL) {
+        open_index_search(&index, searcher_args->index_path, searcher_args->queries, searcher_args->query_count);
+        searcher_args->index = &index;
+    }
+
+    if (searcher_args->watch != NULL) {
+        open_watch(searcher_args->watch, searcher_args->path, searcher_args->walkers, searcher_args->buffer,
+                   searcher_args->range_size, put_found_files, searcher_args);
+    }
+
+    walk_tree(searcher_args->path, searcher_args->walkers, put_found_files, searcher_args);
+
+    if (searcher_args->watch != NULL) {
+        if (searcher_args->index != NULL) {
+            close_index_search(&index);
+            searcher_args->index = NULL; /* changes are searched anyway */
+        }
+        run_watch(searcher_args->watch);
+    }
 
     /* put NULLs (as many as number of minions) to inform controller threads. */
     int i;
     for (i = 0; i < searcher_args->minion_count; ++i) {
         put_buffer(searcher_args->buffer, NULL);
     }
+
+    if (searcher_args->index != NULL) {
+        close_index_search(&index); /* while the minions work */
+    }
     return NULL;
 }
 
 /**
- * Searches txt files in a path and puts them in a buffer.
- * @param path a path of a directory as a string
- * @param buffer pointer of an buffer_t
+ * Puts txt files found by a walker thread to the buffer. Files that the
+ * index rules out are dropped, files larger than the range size are put as
+ * several range jobs. In the ordered mode every file is put as ranges, so
+ * that its matches come as records to be sorted. In watch mode every file
+ * is put through the watch, which keeps its size for the appends.
+ * @param args pointer of an searcher_args_t
+ * @param paths paths of the files
+ * @param count file count
  */
-void search_for_txt(char *path, buffer_t *buffer) {
-    DIR *dir;
-    struct dirent *dp;
-
-    if ((dir = opendir(path)) == NULL) {
-        fprintf(stderr, "[searcher-thread] Cannot open path.\n");
-        exit(1);
-    }
-
-    while ((dp = readdir(dir)) != NULL) {
-        char *subpath = (char *) malloc(strlen(path) + strlen(dp->d_name) + 2);
-        strcpy(subpath, path);
-        strcat(subpath, "/");
-        strcat(subpath, dp->d_name);
-
-        /* some filesystems do not provide d_type */
-        if (dp->d_type == 0) {
-            struct stat path_stat;
-            stat(subpath, &path_stat);
-            if (S_ISDIR(path_stat.st_mode)) {
-                dp->d_type = 4;
-            } else if (S_ISREG(path_stat.st_mode)) {
-                dp->d_type = 8;
+void put_found_files(void *args, char **paths, int count) {
+    searcher_args_t *searcher_args = (searcher_args_t *) args;
+    file_job_t **jobs = (file_job_t **) malloc(sizeof(file_job_t *) * count);
+    trigram_set_t set;
+    init_trigram_set(&set);
+    int i, jobs_count = 0;
+    for (i = 0; i < count; ++i) {
+        struct stat file_stat;
+        int stated = (searcher_args->range_size > 0 || searcher_args->index != NULL ||
+                      searcher_args->watch != NULL || searcher_args->ordered) &&
+                     stat(paths[i], &file_stat) == 0;
+        if (searcher_args->index != NULL &&
+            !is_candidate(searcher_args->index, paths[i], stated ? &file_stat : NULL, &set)) {
+            free(paths[i]);
+            continue;
+        }
+        if (searcher_args->watch != NULL) {
+            if (stated && S_ISREG(file_stat.st_mode)) {
+                watch_file(searcher_args->watch, paths[i], (long long) file_stat.st_size);
+            } else {
+                free(paths[i]);
             }
+            continue;
         }
-
-        /* 4 => directory & 8 => regular file */
-        if (dp->d_type == 4 && strcmp(dp->d_name, ".") != 0 && strcmp(dp->d_name, "..") != 0) {
-            /* iterate over sub directory */
-            search_for_txt(subpath, buffer);
-        } else if (dp->d_type == 8 && is_txt(dp->d_name)) {
-            /* put file to the buffer */
-            put_buffer(buffer, subpath);
+        if (stated && S_ISREG(file_stat.st_mode) &&
+            (searcher_args->ordered ||
+             (searcher_args->range_size > 0 && file_stat.st_size > searcher_args->range_size))) {
+            put_many(searcher_args->buffer, (void **) jobs, jobs_count); /* keep the order */
+            jobs_count = 0;
+            put_split_file(searcher_args->buffer, paths[i], (long long) file_stat.st_size,
+                           searcher_args->range_size);
+        } else {
+            jobs[jobs_count++] = create_file_job(paths[i]);
         }
     }
-}
-
-/**
- * Checks if a filename for a txt file.
- * @param name file name as a string
- * @return 1 if string ends with '.txt', otherwise 0;
- */
-int is_txt(char *name) {
-    size_t length = strlen(name);
-    return length > 4 && strcmp(name + length - 4, ".txt") == 0;
+    put_many(searcher_args->buffer, (void **) jobs, jobs_count);
+    free_trigram_set(&set);
+    free(jobs);
 }
 
 /**
  * Subroutine for controller threads.
- * It communicates with a minion process via a pipe. It takes a file path
- * from the buffer and sends it to the minion process. It writes results
- * that coming from the minion to the log file.
+ * It takes file jobs from the buffer and sends them to its minion process
+ * in batches through a pipe, keeping two batches in flight. It takes the
+ * results of the minion from their shared ring in place, writes them to
+ * the log file, and hands matches of ranges to their splits.
  * @param args pointer of an controller_args_t. Please see main.h
  * @return NULL
  */
 void* controller_routine(void* args) {
     controller_args_t *controller_args = (controller_args_t *) args;
-
+    int searching = 1, in_flight = 0;
+    init_log_buffer(&controller_args->log_buffer, controller_args->log);
     while (1) {
-        char *file_name = read_buffer(controller_args->buffer);
-        if (file_name == NULL) {
-            size_t exit = 0;
-            write(controller_args->write_end, &exit, sizeof(exit));
-            return NULL;
-        }
-
-        size_t file_size = strlen(file_name) + 1;
-        write(controller_args->write_end, &file_size, sizeof(file_size));
-        write(controller_args->write_end, file_name, strlen(file_name) + 1);
-        free(file_name);
-
-        while (1) {
-            size_t message_size;
-            read(controller_args->read_end, &message_size, sizeof(message_size));
-            if (message_size == 0) {
+        while (searching && in_flight < BATCHES_IN_FLIGHT) {
+            /* results of a batch in flight are not kept waiting for new jobs */
+            int sent = send_batch(controller_args, &searching, in_flight == 0);
+            if (sent == 0 && searching) {
                 break;
             }
-
-            char *message = (char *) malloc(message_size);
-            read(controller_args->read_end, message, message_size);
-
-            sem_wait(controller_args->logs_mutex);
-            fprintf(controller_args->logs, "%s", message);
-            sem_post(controller_args->logs_mutex);
-
-            free(message);
+            in_flight += sent > 0;
+        }
+        if (in_flight == 0) {
+            break;
         }
-    }
-}
-
-/**
- * Creates a buffer
- * @param size size of the buffer
- * @return pointer of an buffer_t
- */
-buffer_t* create_buffer(int size) {
-    buffer_t *buffer = (buffer_t *) malloc(sizeof(buffer_t));
-
-    buffer->array = (char **) malloc(size * sizeof(char *));
 
-    buffer->empty = (sem_t *) malloc(sizeof(sem_t));
-    buffer->full = (sem_t *) malloc(sizeof(sem_t));
-    buffer->mutex = (sem_t *) malloc(sizeof(sem_t));
+        const result_frame_t *frame = read_ring(&controller_args->ring);
+        if (frame == NULL || frame->length > RESULT_FRAME_SIZE) {
+            fprintf(stderr, "[controller-thread] A minion is gone.\n");
+            exit(EXIT_FAILURE);
+        }
 
-    buffer->in = 0;
-    buffer->out = 0;
-    buffer->size = size;
+        /* the minion works on its ranges in the order they were sent */
+        file_job_t *job = frame->kind == RESULT_LINES ? NULL : controller_args->ranges[controller_args->range_head];
+        add_results(job, controller_args->id, frame, (const char *) (frame + 1), &controller_args->log_buffer);
+        if (frame->kind == RESULT_RANGE_END) {
+            controller_args->range_head = (controller_args->range_head + 1) % RANGES_IN_FLIGHT;
+            controller_args->range_count--;
+        }
 
-    /* initialize semaphores */
-    sem_init(buffer->empty, 0, (unsigned) size); /* counting semaphore */
-    sem_init(buffer->full, 0, 0); /* counting semaphore */
-    sem_init(buffer->mutex, 0, 1); /* binary semaphore */
+        in_flight -= frame->done;
+        release_ring(&controller_args->ring, frame);
+    }
 
-    return buffer;
+    path_batch_t batch;
+    batch.count = 0; /* tell the minion to exit */
+    write_full(controller_args->write_end, &batch, sizeof(batch));
+    destroy_ring(&controller_args->ring);
+    free_log_buffer(&controller_args->log_buffer);
+    return NULL;
 }
 
 /**
- * Puts the specified item to the buffer.
- * @param buffer pointer of an buffer_t
- * @param value item to be put to the buffer
+ * Takes up to MAX_BATCH_PATHS file jobs from the buffer and sends them to
+ * the minion in one writev. Whole file jobs are freed; range jobs are kept
+ * until their matches come. The log lines of the controller are written
+ * before it waits.
+ * @param controller_args pointer of an controller_args_t
+ * @param searching set to 0 when the end of the search is taken
+ * @param wait 1 to wait for at least one job
+ * @return sent job count
  */
-void put_buffer(buffer_t *buffer, char *value) {
-    /*
-     * Try to get locks and then put the item. After that, release the locks.
-     */
-    sem_wait(buffer->empty);
-    sem_wait(buffer->mutex);
-
-    buffer->array[buffer->in] = value;
-    buffer->in = (buffer->in + 1) % buffer->size;
-
-    sem_post(buffer->mutex);
-    sem_post(buffer->full);
+int send_batch(controller_args_t *controller_args, int *searching, int wait) {
+    file_job_t *jobs[MAX_BATCH_PATHS];
+    path_entry_t entries[MAX_BATCH_PATHS];
+    struct iovec iov[1 + 2 * MAX_BATCH_PATHS];
+
+    int count = try_get_many(controller_args->buffer, (void **) jobs, MAX_BATCH_PATHS);
+    if (count == 0 && wait) {
+        flush_log(&controller_args->log_buffer);
+        count = get_many(controller_args->buffer, (void **) jobs, MAX_BATCH_PATHS);
+    }
+    if (count > 0 && jobs[count - 1] == NULL) {
+        count--; /* a NULL comes last */
+        *searching = 0;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    path_batch_t batch;
+    batch.count = count;
+    iov[0].iov_base = &batch;
+    iov[0].iov_len = sizeof(batch);
+    int i;
+    for (i = 0; i < count; ++i) {
+        entries[i].size = strlen(jobs[i]->path) + 1;
+        entries[i].offset = jobs[i]->offset;
+        entries[i].length = jobs[i]->length;
+        entries[i].file_size = jobs[i]->file_size;
+        entries[i].appended = jobs[i]->appended;
+        iov[1 + 2 * i].iov_base = &entries[i];
+        iov[1 + 2 * i].iov_len = sizeof(path_entry_t);
+        iov[2 + 2 * i].iov_base = jobs[i]->path;
+        iov[2 + 2 * i].iov_len = entries[i].size;
+    }
+    writev_full(controller_args->write_end, iov, 1 + 2 * count);
+
+    for (i = 0; i < count; ++i) {
+        if (jobs[i]->split == NULL) {
+            free(jobs[i]->path);
+            free(jobs[i]);
+        } else {
+            int tail = (controller_args->range_head + controller_args->range_count) % RANGES_IN_FLIGHT;
+            controller_args->ranges[tail] = jobs[i];
+            controller_args->range_count++;
+        }
+    }
+    return count;
 }
 
 /**
- * Reads an item from the buffer.
- * @param buffer pointer of an buffer_t
- * @return a string from the buffer
+ * Subroutine for worker threads, the minions of the threaded mode.
+ * It takes file jobs from the buffer and searches them itself. Log lines
+ * are collected in its own result buffer and handed to its log buffer once
+ * per batch; matches of ranges go to their splits as in the process mode.
+ * @param args pointer of an worker_args_t. Please see main.h
+ * @return NULL
  */
-char *read_buffer(buffer_t *buffer) {
-    /*
-     * Try to get locks and then read an item. Release the locks and
-     * return the item.
-     */
-    sem_wait(buffer->full);
-    sem_wait(buffer->mutex);
-
-    char *item = buffer->array[buffer->out];
-    buffer->out = (buffer->out + 1) % buffer->size;
+void* worker_routine(void* args) {
+    worker_args_t *worker_args = (worker_args_t *) args;
+    search_log_t *log = worker_args->log;
+    FILE *out = open_output(worker_args->id, log->queries, log->query_count);
+    init_log_buffer(&worker_args->log_buffer, log);
+    file_view_t view;
+    memset(&view, 0, sizeof(view));
+    result_buffer_t *results = (result_buffer_t *) malloc(sizeof(result_buffer_t));
+    results->length = 0;
+    results->kind = RESULT_LINES;
+    results->sink = take_results;
+    results->context = worker_args;
+
+    int searching = 1;
+    while (searching) {
+        file_job_t *jobs[MAX_BATCH_PATHS];
+        int count = try_get_many(worker_args->buffer, (void **) jobs, MAX_BATCH_PATHS);
+        if (count == 0) {
+            flush_log(&worker_args->log_buffer); /* before it waits */
+            count = get_many(worker_args->buffer, (void **) jobs, MAX_BATCH_PATHS);
+        }
+        if (jobs[count - 1] == NULL) {
+            count--; /* a NULL comes last */
+            searching = 0;
+        }
 
-    sem_post(buffer->mutex);
-    sem_post(buffer->empty);
+        int i;
+        for (i = 0; i < count; ++i) {
+            path_entry_t entry;
+            entry.size = strlen(jobs[i]->path) + 1;
+            entry.offset = jobs[i]->offset;
+            entry.length = jobs[i]->length;
+            entry.file_size = jobs[i]->file_size;
+            entry.appended = jobs[i]->appended;
+            int whole = jobs[i]->split == NULL; /* a range job is freed with its last matches */
+            worker_args->job = jobs[i];
+            search_in_file(out, worker_args->id, &worker_args->matcher, &view, results, jobs[i]->path, &entry);
+            if (whole) {
+                free(jobs[i]->path);
+                free(jobs[i]);
+            }
+        }
+        if (results->length > 0) {
+            flush_results(results, 0, 0);
+        }
+        fflush(out);
+    }
 
-    return item;
+    free_log_buffer(&worker_args->log_buffer);
+    free(results);
+    free(view.buffer);
+    fclose(out);
+    return NULL;
 }
 
 /**
- * Deallocate dynamic parameters of the buffer and then deallocate itself.
- * @param buffer pointer of an buffer_t
+ * Result sink of a worker thread, see scan.h
+ * @param context pointer of an worker_args_t
+ * @param frame frame header
+ * @param data bytes of the frame
  */
-void destroy_buffer(buffer_t *buffer) {
-    free(buffer->array);
-    free(buffer->empty);
-    free(buffer->full);
-    free(buffer->mutex);
-    free(buffer);
+void take_results(void *context, const result_frame_t *frame, const char *data) {
+    worker_args_t *worker_args = (worker_args_t *) context;
+    add_results(worker_args->job, worker_args->id, frame, data, &worker_args->log_buffer);
 }
@@ -1,42 +1,65 @@
 #ifndef BBM342_EXP2_MAIN_H
 #define BBM342_EXP2_MAIN_H
 
-typedef struct buffer {
-    char **array;
-    sem_t* mutex;
-    sem_t* empty;
-    sem_t* full;
-    int in;
-    int out;
-    int size;
-} buffer_t;
+#include "buffer.h"
+#include "index.h"
+#include "jobs.h"
+#include "log.h"
+#include "protocol.h"
+#include "ring.h"
+#include "scan.h"
+#include "search.h"
+#include "walker.h"
+#include "watch.h"
+
+#define BATCHES_IN_FLIGHT 2  /* batches sent to a minion and not done yet */
+#define RANGES_IN_FLIGHT (BATCHES_IN_FLIGHT * MAX_BATCH_PATHS)
 
 typedef struct searcher_args {
     buffer_t *buffer;
     char *path;
     int minion_count;
+    int walkers;    /* threads of the directory traversal */
+    long long range_size;   /* larger files are split, 0 for never */
+    char *index_path;       /* NULL for no index */
+    index_search_t *index;
+    watch_t *watch;         /* NULL if not watching */
+    int ordered;            /* every file is put as ranges */
+    char **queries;
+    int query_count;
 } searcher_args_t;
 
 typedef struct controller_args {
     buffer_t *buffer;
-    int read_end;
     int write_end;
-    FILE *logs;
-    sem_t* logs_mutex;
+    result_ring_t ring;     /* results of its minion */
+    search_log_t *log;
+    log_buffer_t log_buffer;
+    char id[12];    /* id of its minion */
+    file_job_t *ranges[RANGES_IN_FLIGHT];  /* sent range jobs, in order */
+    int range_head;
+    int range_count;
 } controller_args_t;
 
+typedef struct worker_args {
+    buffer_t *buffer;
+    search_log_t *log;
+    log_buffer_t log_buffer;
+    matcher_t matcher;      /* its own, the DFAs of expressions are built as it searches */
+    char id[12];    /* id of the minion it stands for */
+    file_job_t *job;            /* job being searched */
+} worker_args_t;
+
 /* Searcher thread routine and its helper methods */
 void* searcher_routine(void* args);
-void search_for_txt(char *path, buffer_t *buffer);
-int is_txt(char *name);
+void put_found_files(void *args, char **paths, int count);
 
-/* Controller thread routine */
+/* Controller thread routine and its helper method */
 void* controller_routine(void* args);
+int send_batch(controller_args_t *controller_args, int *searching, int wait);
 
-/* Buffer operations */
-buffer_t* create_buffer(int size);
-void put_buffer(buffer_t *buffer, char *value);
-char *read_buffer(buffer_t *buffer);
-void destroy_buffer(buffer_t *buffer);
+/* Worker thread routine and its result sink */
+void* worker_routine(void* args);
+void take_results(void *context, const result_frame_t *frame, const char *data);
 
 #endif
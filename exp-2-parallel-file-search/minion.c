@@ -3,92 +3,123 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <ctype.h>
+#include <poll.h>
 
 #include "minion.h"
 
 /**
  * Main function of minion
- * Reads a file from a controller thread of the main process. And searches
- * the query in this file.
+ * Reads files and file ranges from a controller thread of the main process.
+ * And searches the queries in them.
  * @param argc argument count
- * @param argv argument vector
+ * @param argv argument vector, -e for regular expressions, id and one or
+ * more queries
  * @return status value as integer
  */
 int main(int argc, char *argv[]) {
-    char output_file[15];
-    sprintf(output_file, "minion%s.out", argv[1]);
-    FILE* out = fopen(output_file, "w");
+    int regex = argc > 1 && strcmp(argv[1], "-e") == 0;
+    argc -= regex;
+    argv += regex;
+    int i, query_count = argc - 2;
+    FILE* out = open_output(argv[1], argv + 2, query_count);
 
-    fprintf(out, "Search for \"%s\" string on Minion%s\n", argv[2], argv[1]);
-    fprintf(out, "----------------------\n");
+    matcher_t matcher;
+    compile_matcher(&matcher, argv + 2, query_count, regex); /* once for all files */
+    file_view_t view;
+    memset(&view, 0, sizeof(view));
+    result_buffer_t *results = (result_buffer_t *) malloc(sizeof(result_buffer_t));
+    results->length = 0;
+    results->kind = RESULT_LINES;
+    result_ring_t ring;
+    attach_ring(&ring, STDIN_FILENO);
+    results->sink = write_frame;
+    results->context = &ring;
+    file_reader_t *reader = (file_reader_t *) malloc(sizeof(file_reader_t));
+    open_reader(reader); /* falls back to open_file_view without io_uring */
 
-    while (1) {
-        size_t input_size;
-        read(STDIN_FILENO, &input_size, sizeof(input_size));
-
-        if (input_size == 0) {
-            fclose(out);
-            return EXIT_SUCCESS;
+    /* the next batch is taken while one is searched once the controller
+     * has sent it, so the reads of its files start before this one ends */
+    minion_batch_t batches[2];
+    int current = 0, ahead = 0;
+    int more = take_batch(reader, &batches[0]);
+    while (more) {
+        minion_batch_t *batch = &batches[current];
+        minion_batch_t *next = &batches[1 - current];
+        more = !batch->last;
+        for (i = 0; i < batch->count; ++i) {
+            if (more && !ahead && batch_waiting()) {
+                ahead = more = take_batch(reader, next);
+            }
+            load_file(reader, batch->first + i, &view);
+            search_in_file(out, argv[1], &matcher, &view, results, batch->inputs[i], &batch->entries[i]);
+            release_file(reader, batch->first + i);
+            free(batch->inputs[i]);
         }
-
-        char *input = (char *) malloc(input_size);
-        read(STDIN_FILENO, input, input_size);
-        search_in_file(out, argv[1], argv[2], input);
+        fflush(out); /* a watching main runs until it is killed */
+        flush_results(results, 1, 0);
+        if (more && !ahead) {
+            more = take_batch(reader, next);
+        }
+        ahead = 0;
+        current = 1 - current;
     }
+
+    close_reader(reader);
+    free(reader);
+    free(results);
+    free_matcher(&matcher);
+    free(view.buffer);
+    fclose(out);
+    return EXIT_SUCCESS;
 }
 
 /**
- * Searches the query line by line in a file.
- * @param out output file descriptor
- * @param id minion process' id
- * @param query search query
- * @param file input file
+ * Takes a batch out of the pipe of the controller, so the next one fits in
+ * it, and starts reading its files.
+ * @param reader pointer of an file_reader_t
+ * @param batch pointer of an minion_batch_t, filled
+ * @return 1 if the batch has files to search, 0 at the end
  */
-void search_in_file(FILE *out, char *id, char *query, char *file) {
-    FILE* in = fopen(file, "r");
-    if (in == NULL) {
-        fprintf(stderr, "Cannot open the file.\n");
-        return;
+int take_batch(file_reader_t *reader, minion_batch_t *batch) {
+    path_batch_t header;
+    if (!read_full(STDIN_FILENO, &header, sizeof(header)) || header.count <= 0) {
+        return 0;
     }
-    to_lower_case(query);
-
-    char *line = NULL;
-    size_t len = 0;
-
-    int line_number = 1;
-    while (getline(&line, &len, in) != -1) {
-        to_lower_case(line);
-
-        char *match = line;
-        int offset = 0;
-        while ((match = strstr(match, query)) != NULL) {
-            unsigned long pos = match - line + 1;
-            char message[256];
-            sprintf(message, "minion%s: %s:%d:%ld\n", id, file, line_number, pos + offset);
-
-            size_t message_size = strlen(message) + 1;
-            fprintf(out, "%s", message);
-            write(STDOUT_FILENO, &message_size, sizeof(message_size));
-            write(STDOUT_FILENO, message, message_size);
-
-            match++;
+    int count = 0;
+    while (count < header.count && count < MAX_BATCH_PATHS) {
+        if (!read_full(STDIN_FILENO, &batch->entries[count], sizeof(path_entry_t))) {
+            break;
         }
-        line_number++;
+        batch->inputs[count] = (char *) malloc(batch->entries[count].size);
+        if (!read_full(STDIN_FILENO, batch->inputs[count], batch->entries[count].size)) {
+            free(batch->inputs[count]);
+            break;
+        }
+        count++;
     }
-    size_t message_size = 0;
-    write(STDOUT_FILENO, &message_size, sizeof(message_size));
+    batch->count = count;
+    batch->last = count < header.count;
+    batch->first = start_reads(reader, batch->inputs, batch->entries, count);
+    return count > 0;
+}
 
-    fclose(in);
+/**
+ * Checks whether the controller has sent the next batch.
+ * @return 1 if the pipe of the controller is readable
+ */
+int batch_waiting(void) {
+    struct pollfd input;
+    input.fd = STDIN_FILENO;
+    input.events = POLLIN;
+    return poll(&input, 1, 0) > 0;
 }
 
 /**
- * Converts all of the characters in a string to lower case.
- * @param str char pointer of a string
+ * Writes a result frame to the ring of the controller.
+ * @param context pointer of an result_ring_t
+ * @param frame frame header
+ * @param data bytes of the frame
  */
-void to_lower_case(char *str) {
-    int i;
-    for (i = 0; str[i]; i++) {
-        str[i] = (char) tolower(str[i]);
-    }
+void write_frame(void *context, const result_frame_t *frame, const char *data) {
+    write_ring((result_ring_t *) context, frame, data);
 }
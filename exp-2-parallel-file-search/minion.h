@@ -1,7 +1,22 @@
 #ifndef BBM342_EXP2_MINION_H
 #define BBM342_EXP2_MINION_H
 
-void search_in_file(FILE *out, char *id, char *query, char *input_file);
-void to_lower_case(char *text);
+#include "protocol.h"
+#include "reader.h"
+#include "ring.h"
+#include "scan.h"
+
+/* Batch taken out of the pipe of the controller */
+typedef struct minion_batch {
+    path_entry_t entries[MAX_BATCH_PATHS];
+    char *inputs[MAX_BATCH_PATHS];
+    int count;
+    int first;      /* index of its first file in the reader */
+    int last;       /* the controller is gone, no batch follows */
+} minion_batch_t;
+
+int take_batch(file_reader_t *reader, minion_batch_t *batch);
+int batch_waiting(void);
+void write_frame(void *context, const result_frame_t *frame, const char *data);
 
 #endif
@@ -0,0 +1,122 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * Controller-minion pipe protocol
+ *
+ * A controller sends paths to its minion in batches and keeps up to two
+ * batches in flight, so the minion always finds its next files in the pipe.
+ * The minion collects the log lines of its matches and sends them as result
+ * frames of up to RESULT_FRAME_SIZE bytes, one writev each, so the pipe
+ * traffic follows the bytes of the results and not their count.
+ *
+ * A large file is searched as several byte ranges by different minions. A
+ * range owns the matches that start in it and is scanned a query length
+ * further. Its matches come back as records with line numbers counted from
+ * the range start, together with its newline count, and the controllers
+ * write them once the newlines of every range before are known.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+/**
+ * Reads exactly size bytes, retrying short reads of the pipe.
+ * @param fd file descriptor
+ * @param buf destination
+ * @param size byte count
+ * @return 1 on success, 0 on end of file or error
+ */
+int read_full(int fd, void *buf, size_t size) {
+    char *p = (char *) buf;
+    while (size > 0) {
+        ssize_t r = read(fd, p, size);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return 0;
+        }
+        p += r;
+        size -= (size_t) r;
+    }
+    return 1;
+}
+
+/**
+ * Writes exactly size bytes, retrying short writes of the pipe.
+ * @param fd file descriptor
+ * @param buf source
+ * @param size byte count
+ * @return 1 on success, 0 on error
+ */
+int write_full(int fd, const void *buf, size_t size) {
+    const char *p = (const char *) buf;
+    while (size > 0) {
+        ssize_t w = write(fd, p, size);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return 0;
+        }
+        p += w;
+        size -= (size_t) w;
+    }
+    return 1;
+}
+
+/**
+ * Writes every buffer of an iovec array, retrying short writes.
+ * @param fd file descriptor
+ * @param iov buffers, modified on short writes
+ * @param count buffer count
+ * @return 1 on success, 0 on error
+ */
+int writev_full(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t w = writev(fd, iov, count);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w <= 0) {
+            return 0;
+        }
+        /* skip fully written buffers and advance the partial one */
+        while (count > 0 && (size_t) w >= iov->iov_len) {
+            w -= (ssize_t) iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + w;
+            iov->iov_len -= (size_t) w;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Formats the log line of a match, truncated to MESSAGE_SIZE bytes.
+ * @param message destination, MESSAGE_SIZE bytes
+ * @param id minion process' id, NULL for no prefix
+ * @param file path of the file
+ * @param line line number
+ * @param column position of the match in its line
+ * @param query matching query, NULL if there is only one
+ * @return byte count of the line without its NUL
+ */
+int format_match(char *message, const char *id, const char *file, int line, long column, const char *query) {
+    int size = id != NULL ? snprintf(message, MESSAGE_SIZE, "minion%s: ", id) : 0;
+    if (query == NULL) {
+        size += snprintf(message + size, MESSAGE_SIZE - size, "%s:%d:%ld\n", file, line, column);
+    } else {
+        size += snprintf(message + size, MESSAGE_SIZE - size, "%s:%d:%ld \"%s\"\n", file, line, column, query);
+    }
+    return size < MESSAGE_SIZE ? size : MESSAGE_SIZE - 1;
+}
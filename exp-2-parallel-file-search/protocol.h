@@ -0,0 +1,56 @@
+#ifndef BBM342_EXP2_PROTOCOL_H
+#define BBM342_EXP2_PROTOCOL_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#define MAX_BATCH_PATHS     8           /* paths of a batch, see path_batch_t */
+#define RESULT_FRAME_SIZE   (1 << 16)   /* bytes of a result frame at most */
+#define MESSAGE_SIZE        4096        /* bytes of a log line at most */
+
+/* Kinds of result frames */
+#define RESULT_LINES        0   /* log lines of whole files */
+#define RESULT_MATCHES      1   /* range_match_t records of the current range */
+#define RESULT_RANGE_END    2   /* last records of the current range */
+
+/* Header of a batch of paths from a controller to its minion, followed by
+ * count paths, each one as a path_entry_t and the NUL terminated path.
+ * An empty batch tells the minion to exit. */
+typedef struct path_batch {
+    int count;
+} path_batch_t;
+
+/* A whole file, or the bytes [offset, offset + length) of it. A range is
+ * searched in the first file_size bytes of the file only, the bytes after
+ * them are searched by the ranges appended later. */
+typedef struct path_entry {
+    size_t size;            /* bytes of the path with its NUL */
+    long long offset;
+    long long length;       /* -1 for the whole file */
+    long long file_size;
+    int appended;           /* matches can start before offset, see minion.c */
+} path_entry_t;
+
+/* Header of a block of results from a minion, followed by length bytes.
+ * The last frame of a batch has done set. */
+typedef struct result_frame {
+    size_t length;
+    int kind;               /* RESULT_LINES, RESULT_MATCHES or RESULT_RANGE_END */
+    int done;
+    long long newlines;     /* newlines of the range, RESULT_RANGE_END */
+} result_frame_t;
+
+/* Match in a range. Its line is counted from the line of the range start,
+ * the controller adds the newlines of the ranges before it. */
+typedef struct range_match {
+    int line;
+    int query;
+    long column;
+} range_match_t;
+
+int read_full(int fd, void *buf, size_t size);
+int write_full(int fd, const void *buf, size_t size);
+int writev_full(int fd, struct iovec *iov, int count);
+int format_match(char *message, const char *id, const char *file, int line, long column, const char *query);
+
+#endif
@@ -0,0 +1,306 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * Asynchronous file reader
+ *
+ * A minion searches the files of a batch one by one, and on a cold cache
+ * it would wait for one read at a time. The reader keeps the reads of the
+ * small files of the batch, and of the next batch once the minion has taken
+ * it, in flight with io_uring, each into its own registered buffer, so the
+ * next files are on their way while one is searched. Files that are mapped
+ * by scan.c (large files and ranges) are left to it, and so is every file
+ * if io_uring is not available.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "reader.h"
+
+static void start_files(file_reader_t *reader);
+static void queue_read(file_reader_t *reader, int i);
+static void submit_reads(file_reader_t *reader, int wait);
+static void reap_reads(file_reader_t *reader);
+
+/**
+ * Creates an io_uring instance and registers the buffers of the reader.
+ * If io_uring is not available (an old kernel, seccomp or
+ * kernel.io_uring_disabled), reader->fd is -1 and nothing is read by it.
+ * @param reader pointer of an file_reader_t
+ */
+void open_reader(file_reader_t *reader) {
+    memset(reader, 0, sizeof(file_reader_t));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    reader->fd = (int) syscall(__NR_io_uring_setup, READER_DEPTH, &params);
+    if (reader->fd < 0) {
+        reader->fd = -1;
+        return;
+    }
+
+    reader->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    reader->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    reader->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && reader->cq_ring_size > reader->sq_ring_size) {
+        reader->sq_ring_size = reader->cq_ring_size;
+    }
+    reader->sq_ring = mmap(NULL, reader->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           reader->fd, IORING_OFF_SQ_RING);
+    reader->cq_ring = single ? reader->sq_ring
+                             : mmap(NULL, reader->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                    reader->fd, IORING_OFF_CQ_RING);
+    reader->sqes = (struct io_uring_sqe *) mmap(NULL, reader->sqes_size, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_POPULATE, reader->fd, IORING_OFF_SQES);
+    reader->slots = (char *) mmap(NULL, (size_t) READER_DEPTH * READER_SLOT, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reader->sq_ring == MAP_FAILED || reader->cq_ring == MAP_FAILED ||
+        reader->sqes == MAP_FAILED || reader->slots == MAP_FAILED) {
+        if (reader->cq_ring != MAP_FAILED && !single) {
+            munmap(reader->cq_ring, reader->cq_ring_size);
+        }
+        if (reader->sq_ring != MAP_FAILED) {
+            munmap(reader->sq_ring, reader->sq_ring_size);
+        }
+        if (reader->sqes != MAP_FAILED) {
+            munmap(reader->sqes, reader->sqes_size);
+        }
+        if (reader->slots != MAP_FAILED) {
+            munmap(reader->slots, (size_t) READER_DEPTH * READER_SLOT);
+        }
+        close(reader->fd);
+        reader->fd = -1;
+        return;
+    }
+
+    char *sq = (char *) reader->sq_ring, *cq = (char *) reader->cq_ring;
+    reader->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    reader->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    reader->sq_array = (unsigned *) (sq + params.sq_off.array);
+    reader->cq_head = (unsigned *) (cq + params.cq_off.head);
+    reader->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    reader->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    reader->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    /* registered buffers are pinned once, not for every read; without them
+     * (a low RLIMIT_MEMLOCK on old kernels) plain reads are used */
+    struct iovec iov[READER_DEPTH];
+    int i;
+    for (i = 0; i < READER_DEPTH; ++i) {
+        iov[i].iov_base = reader->slots + (size_t) i * READER_SLOT;
+        iov[i].iov_len = READER_SLOT;
+        reader->free_slots[i] = READER_DEPTH - 1 - i;
+    }
+    reader->fixed = syscall(__NR_io_uring_register, reader->fd, IORING_REGISTER_BUFFERS, iov, READER_DEPTH) == 0;
+    reader->free_count = READER_DEPTH;
+}
+
+/**
+ * Closes the io_uring instance of a reader and frees its buffers. Every
+ * read of the last batches is completed.
+ * @param reader pointer of an file_reader_t
+ */
+void close_reader(file_reader_t *reader) {
+    if (reader->fd < 0) {
+        return;
+    }
+    if (reader->cq_ring != reader->sq_ring) {
+        munmap(reader->cq_ring, reader->cq_ring_size);
+    }
+    munmap(reader->sq_ring, reader->sq_ring_size);
+    munmap(reader->sqes, reader->sqes_size);
+    close(reader->fd);
+    munmap(reader->slots, (size_t) READER_DEPTH * READER_SLOT);
+    reader->fd = -1;
+}
+
+/**
+ * Starts reading the files of a batch, as many as there are free buffers.
+ * At most two batches are given to the reader before their files are
+ * released, so every file of them gets a buffer.
+ * @param reader pointer of an file_reader_t
+ * @param files paths of the files, kept until their release_file
+ * @param entries ranges of the files, kept until their release_file
+ * @param count file count, at most MAX_BATCH_PATHS
+ * @return index of the first file of the batch in the reader
+ */
+int start_reads(file_reader_t *reader, char **files, const path_entry_t *entries, int count) {
+    int first = reader->added, i;
+    for (i = 0; i < count; ++i) {
+        file_read_t *read = &reader->reads[(first + i) % READER_DEPTH];
+        read->path = files[i];
+        read->entry = &entries[i];
+    }
+    reader->added += count;
+    if (reader->fd >= 0) {
+        start_files(reader);
+    }
+    return first;
+}
+
+/**
+ * Waits until a file is read and gives it to a view. Files are loaded and
+ * released in the order they are given to the reader.
+ * @param reader pointer of an file_reader_t
+ * @param i index of the file in the reader
+ * @param view pointer of an file_view_t, loaded on success
+ * @return 1 if the file is loaded, 0 if it is left to open_file_view
+ */
+int load_file(file_reader_t *reader, int i, file_view_t *view) {
+    file_read_t *read = &reader->reads[i % READER_DEPTH];
+    if (reader->fd < 0 || i >= reader->next || read->slot < 0) {
+        return 0;
+    }
+    while (read->done == 0) {
+        reap_reads(reader);
+        if (read->done == 0) {
+            submit_reads(reader, 1);
+        }
+    }
+    if (read->done < 0) {
+        release_file(reader, i); /* read again by scan.c, which reports the error */
+        return 0;
+    }
+    view->data = reader->slots + (size_t) read->slot * READER_SLOT;
+    view->length = read->length;
+    view->mapped = 0;
+    view->loaded = 1;
+    return 1;
+}
+
+/**
+ * Gives the buffer of a searched file to the next file.
+ * @param reader pointer of an file_reader_t
+ * @param i index of the file in the reader
+ */
+void release_file(file_reader_t *reader, int i) {
+    file_read_t *read = &reader->reads[i % READER_DEPTH];
+    if (reader->fd < 0 || i >= reader->next || read->slot < 0) {
+        return;
+    }
+    reader->free_slots[reader->free_count++] = read->slot;
+    read->slot = -1;
+    start_files(reader);
+}
+
+/**
+ * Opens the next files and queues their reads while there are free
+ * buffers. Ranges, and files that are empty or mapped by scan.c, are
+ * skipped.
+ * @param reader pointer of an file_reader_t
+ */
+static void start_files(file_reader_t *reader) {
+    while (reader->free_count > 0 && reader->next < reader->added) {
+        int i = reader->next++;
+        file_read_t *read = &reader->reads[i % READER_DEPTH];
+        read->fd = -1;
+        read->slot = -1;
+        read->length = 0;
+        read->done = 0;
+        if (read->entry->length >= 0) {
+            continue;
+        }
+        int fd = open(read->path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) ||
+            file_stat.st_size == 0 || file_stat.st_size >= READER_SLOT) {
+            close(fd);
+            continue;
+        }
+        read->fd = fd;
+        read->size = (size_t) file_stat.st_size;
+        read->slot = reader->free_slots[--reader->free_count];
+        queue_read(reader, i % READER_DEPTH);
+    }
+    submit_reads(reader, 0);
+}
+
+/**
+ * Queues a read of the rest of a file into its buffer.
+ * @param reader pointer of an file_reader_t
+ * @param i index of the read in reader->reads
+ */
+static void queue_read(file_reader_t *reader, int i) {
+    file_read_t *read = &reader->reads[i];
+    unsigned index = (*reader->sq_tail + reader->queued) & *reader->sq_mask;
+    struct io_uring_sqe *sqe = &reader->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = reader->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = read->fd;
+    sqe->off = read->length;
+    sqe->addr = (unsigned long) (reader->slots + (size_t) read->slot * READER_SLOT + read->length);
+    sqe->len = (unsigned) (read->size - read->length);
+    sqe->buf_index = (unsigned short) read->slot;
+    sqe->user_data = (unsigned long long) i;
+    reader->sq_array[index] = index;
+    reader->queued++;
+}
+
+/**
+ * Submits the queued reads, and waits for a completion if asked to.
+ * @param reader pointer of an file_reader_t
+ * @param wait 1 to wait for at least one completion
+ */
+static void submit_reads(file_reader_t *reader, int wait) {
+    if (reader->queued == 0 && !wait) {
+        return;
+    }
+    __atomic_store_n(reader->sq_tail, *reader->sq_tail + reader->queued, __ATOMIC_RELEASE);
+    unsigned queued = reader->queued;
+    reader->queued = 0;
+    while (syscall(__NR_io_uring_enter, reader->fd, queued, wait ? 1 : 0,
+                   wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0) < 0) {
+        if (errno != EINTR) { /* the completions never overflow, at most READER_DEPTH are in flight */
+            fprintf(stderr, "[reader] io_uring_enter failed.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * Takes the completed reads. A short read is queued again for the rest of
+ * the file; a file that got shorter ends at its end.
+ * @param reader pointer of an file_reader_t
+ */
+static void reap_reads(file_reader_t *reader) {
+    unsigned head = *reader->cq_head;
+    unsigned tail = __atomic_load_n(reader->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe *cqe = &reader->cqes[head & *reader->cq_mask];
+        int i = (int) cqe->user_data;
+        file_read_t *read = &reader->reads[i];
+        if (cqe->res == -EINTR || cqe->res == -EAGAIN) {
+            queue_read(reader, i);
+            continue;
+        } else if (cqe->res < 0) {
+            read->done = -1;
+        } else if (cqe->res == 0) {
+            read->done = 1;
+        } else {
+            read->length += (size_t) cqe->res;
+            if (read->length < read->size) {
+                queue_read(reader, i);
+                continue;
+            }
+            read->done = 1;
+        }
+        close(read->fd);
+        read->fd = -1;
+    }
+    __atomic_store_n(reader->cq_head, head, __ATOMIC_RELEASE);
+    submit_reads(reader, 0);
+}
@@ -0,0 +1,57 @@
+#ifndef BBM342_EXP2_READER_H
+#define BBM342_EXP2_READER_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+#include "protocol.h"
+#include "scan.h"
+
+#define READER_DEPTH    (2 * MAX_BATCH_PATHS)   /* the current and the next batch */
+#define READER_SLOT     MMAP_THRESHOLD          /* larger files are mapped */
+
+/* Read of a file of a batch */
+typedef struct file_read {
+    const char *path;
+    const path_entry_t *entry;
+    int fd;
+    int slot;           /* -1 if it is not read by the reader */
+    size_t size;
+    size_t length;      /* bytes read so far */
+    int done;           /* 1 once it is read, -1 on an error */
+} file_read_t;
+
+/* Reads the small files of the batches with io_uring, several at a time,
+ * into registered buffers. Without io_uring, every file is read by scan.c. */
+typedef struct file_reader {
+    int fd;                     /* io_uring instance, -1 if unavailable */
+    int fixed;                  /* the slots are registered buffers */
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    void *cq_ring;              /* same as sq_ring with IORING_FEAT_SINGLE_MMAP */
+    size_t cq_ring_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned queued;            /* sqes not submitted yet */
+    char *slots;                /* READER_DEPTH buffers of READER_SLOT bytes */
+    int free_slots[READER_DEPTH];
+    int free_count;
+    int added;                  /* files given to the reader */
+    int next;                   /* next file to be started */
+    file_read_t reads[READER_DEPTH]; /* file i at i % READER_DEPTH */
+} file_reader_t;
+
+void open_reader(file_reader_t *reader);
+void close_reader(file_reader_t *reader);
+int start_reads(file_reader_t *reader, char **files, const path_entry_t *entries, int count);
+int load_file(file_reader_t *reader, int i, file_view_t *view);
+void release_file(file_reader_t *reader, int i);
+
+#endif
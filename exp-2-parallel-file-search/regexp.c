@@ -0,0 +1,846 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * Regular expressions
+ *
+ * Expressions are case-insensitive and match within a line. They have
+ * literals, ., [classes], \d \w \s and their negations, ^, $, groups, |,
+ * *, + and ?; there are no bounded repeats or back references.
+ *
+ * A match of an expression is reported at its start, as a query is at every
+ * place it occurs. The starts of the matches in a line are found in a
+ * single backwards pass: the line is read from its end by the NFA of the
+ * reversed expression with a loop at its start, and the NFA is in its match
+ * state right after it reads the first byte of a match. ^ and $ are a
+ * symbol of their own, the line boundary, that is read before and after
+ * the bytes of the line.
+ *
+ * The NFA is run as a DFA whose states are the sets of the NFA states. They
+ * are built when they are first reached and cached, so a search never
+ * backtracks. At most DFA_MAX_STATES are kept; when they are all used, the
+ * DFA is built again from the state it is in.
+ *
+ * Every match has the literal that required_literal finds, if any, so the
+ * lines without it are not read by the DFA at all (see search.c).
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "regexp.h"
+
+#define NFA_SET     0
+#define NFA_SPLIT   1
+#define NFA_EMPTY   2
+#define NFA_MATCH   3
+
+#define NODE_SET         0
+#define NODE_EMPTY       1
+#define NODE_CONCAT      2
+#define NODE_ALTERNATE   3
+#define NODE_STAR        4
+#define NODE_PLUS        5
+#define NODE_QUESTION    6
+
+#define HAS_SYMBOL(set, symbol) (((set)[(symbol) >> 3] >> ((symbol) & 7)) & 1)
+#define ADD_SYMBOL(set, symbol) ((set)[(symbol) >> 3] |= (unsigned char) (1 << ((symbol) & 7)))
+
+/* Node of the syntax tree of an expression */
+typedef struct regexp_node {
+    int type;
+    struct regexp_node *left;
+    struct regexp_node *right;      /* NODE_CONCAT and NODE_ALTERNATE */
+    unsigned char set[(SYMBOL_COUNT + 7) / 8];  /* NODE_SET */
+} regexp_node_t;
+
+/* Position of the parser in an expression */
+typedef struct parser {
+    const char *expression;
+    const unsigned char *p;
+} parser_t;
+
+/* Literals of the matches of a node, all folded and malloc'ed */
+typedef struct literal_info {
+    char *exact;    /* every match is it, NULL if the matches differ */
+    char *prefix;   /* every match starts with it */
+    char *suffix;   /* every match ends with it */
+    char *must;     /* every match has it */
+} literal_info_t;
+
+/* NFA of a node, its end is an NFA_EMPTY state to be linked */
+typedef struct fragment {
+    int start;
+    int end;
+} fragment_t;
+
+static regexp_node_t *parse_expression(const char *expression);
+static regexp_node_t *parse_alternation(parser_t *parser);
+static regexp_node_t *parse_concatenation(parser_t *parser);
+static regexp_node_t *parse_repetition(parser_t *parser);
+static regexp_node_t *parse_atom(parser_t *parser);
+static void parse_class(parser_t *parser, regexp_node_t *node);
+static int parse_escape(parser_t *parser, unsigned char *set);
+static void fail(const parser_t *parser, const char *message);
+static regexp_node_t *new_node(int type, regexp_node_t *left, regexp_node_t *right);
+static void free_node(regexp_node_t *node);
+static void add_folded(unsigned char *set, int c);
+static void negate_set(unsigned char *set);
+static literal_info_t find_literals(const regexp_node_t *node);
+static void free_literals(literal_info_t *info);
+static char *join(const char *a, const char *b);
+static char *longest(char *a, char *b);
+static int add_state(regexp_t *regexp, int type, int out, int out1, const unsigned char *set);
+static fragment_t build_reversed(regexp_t *regexp, const regexp_node_t *node);
+static void find_classes(regexp_t *regexp);
+static int close_states(regexp_t *regexp, const int *states, int count);
+static int find_dfa_state(regexp_t *regexp, int count);
+static int step_dfa(regexp_t *regexp, int state, int symbol_class);
+static void start_dfa(regexp_t *regexp);
+static void clear_dfa(regexp_t *regexp);
+static int compare_states(const void *a, const void *b);
+
+/**
+ * Compiles an expression into the NFA of its reversal. Its DFA is built
+ * as it is used. Exits on a syntax error.
+ * @param regexp pointer of an regexp_t
+ * @param expression the expression
+ */
+void compile_regexp(regexp_t *regexp, const char *expression) {
+    memset(regexp, 0, sizeof(regexp_t));
+    regexp_node_t *root = parse_expression(expression);
+    literal_info_t info = find_literals(root);
+    regexp->literal = info.must;
+    info.must = NULL;
+    free_literals(&info);
+
+    /* the loop reads any symbol before the start of the reversed expression */
+    unsigned char any[(SYMBOL_COUNT + 7) / 8];
+    memset(any, 0xff, sizeof(any));
+    int loop = add_state(regexp, NFA_SPLIT, -1, -1, NULL);
+    int skip = add_state(regexp, NFA_SET, loop, -1, any);
+    fragment_t reversed = build_reversed(regexp, root);
+    regexp->nfa[loop].out = skip;
+    regexp->nfa[loop].out1 = reversed.start;
+    regexp->nfa[reversed.end].out = add_state(regexp, NFA_MATCH, -1, -1, NULL);
+    regexp->start = loop;
+    free_node(root);
+    find_classes(regexp);
+
+    regexp->dfa_next = (int *) malloc(sizeof(int) * DFA_MAX_STATES * regexp->classes);
+    regexp->dfa_accepting = (char *) malloc(DFA_MAX_STATES);
+    regexp->dfa_offsets = (size_t *) malloc(sizeof(size_t) * DFA_MAX_STATES);
+    regexp->dfa_sizes = (int *) malloc(sizeof(int) * DFA_MAX_STATES);
+    regexp->dfa_hash = (int *) malloc(sizeof(int) * 2 * DFA_MAX_STATES);
+    regexp->closure = (int *) malloc(sizeof(int) * regexp->nfa_count);
+    regexp->stack = (int *) malloc(sizeof(int) * 3 * regexp->nfa_count); /* a state is pushed by two others at most */
+    regexp->marks = (int *) calloc((size_t) regexp->nfa_count, sizeof(int));
+    if (!regexp->dfa_next || !regexp->dfa_accepting || !regexp->dfa_offsets || !regexp->dfa_sizes ||
+        !regexp->dfa_hash || !regexp->closure || !regexp->stack || !regexp->marks) {
+        exit(EXIT_FAILURE);
+    }
+    clear_dfa(regexp);
+}
+
+/**
+ * Deallocates the NFA and the DFA of an expression.
+ * @param regexp pointer of an regexp_t
+ */
+void free_regexp(regexp_t *regexp) {
+    free(regexp->nfa);
+    free(regexp->representative);
+    free(regexp->literal);
+    free(regexp->dfa_next);
+    free(regexp->dfa_accepting);
+    free(regexp->dfa_offsets);
+    free(regexp->dfa_sizes);
+    free(regexp->dfa_pool);
+    free(regexp->dfa_hash);
+    free(regexp->closure);
+    free(regexp->stack);
+    free(regexp->marks);
+    free(regexp->starts);
+    memset(regexp, 0, sizeof(regexp_t));
+}
+
+/**
+ * Finds the longest literal that every match of an expression has. Exits
+ * on a syntax error, so it checks an expression too.
+ * @param expression the expression
+ * @return malloc'ed folded literal, "" if there is none
+ */
+char *required_literal(const char *expression) {
+    regexp_node_t *root = parse_expression(expression);
+    literal_info_t info = find_literals(root);
+    char *literal = info.must;
+    info.must = NULL;
+    free_literals(&info);
+    free_node(root);
+    return literal;
+}
+
+/**
+ * Finds the starts of the matches in a line.
+ * @param regexp compiled expression
+ * @param line the line, without its newline
+ * @param length byte count of the line
+ * @param starts set to the offsets of the starts in the line, in order,
+ * valid until the next call
+ * @return match count
+ */
+size_t match_line(regexp_t *regexp, const char *line, size_t length, const size_t **starts) {
+    if (regexp->starts_capacity < length) {
+        regexp->starts_capacity = length;
+        regexp->starts = (size_t *) realloc(regexp->starts, sizeof(size_t) * length);
+    }
+    if (regexp->dfa_start < 0) {
+        start_dfa(regexp);
+    }
+    const unsigned char *s = (const unsigned char *) line;
+    int classes = regexp->classes;
+    int state = regexp->dfa_start;
+    size_t count = 0, i = length;
+    while (i-- > 0) {
+        int symbol_class = regexp->class_of[s[i]];
+        int next = regexp->dfa_next[state * classes + symbol_class];
+        state = next >= 0 ? next : step_dfa(regexp, state, symbol_class);
+        if (regexp->dfa_accepting[state] ||
+            (i == 0 && regexp->dfa_accepting[step_dfa(regexp, state, regexp->boundary)])) {
+            regexp->starts[count++] = i;
+        }
+    }
+    for (i = 0; i < count / 2; ++i) {
+        size_t start = regexp->starts[i];
+        regexp->starts[i] = regexp->starts[count - 1 - i];
+        regexp->starts[count - 1 - i] = start;
+    }
+    *starts = regexp->starts;
+    return count;
+}
+
+/**
+ * Parses a whole expression. Exits on a syntax error.
+ * @param expression the expression
+ * @return root of its syntax tree
+ */
+static regexp_node_t *parse_expression(const char *expression) {
+    parser_t parser;
+    parser.expression = expression;
+    parser.p = (const unsigned char *) expression;
+    regexp_node_t *root = parse_alternation(&parser);
+    if (*parser.p == ')') {
+        fail(&parser, "Unmatched )");
+    }
+    return root;
+}
+
+/**
+ * alternation := concatenation ('|' concatenation)*
+ * @param parser pointer of an parser_t
+ * @return the node
+ */
+static regexp_node_t *parse_alternation(parser_t *parser) {
+    regexp_node_t *node = parse_concatenation(parser);
+    while (*parser->p == '|') {
+        parser->p++;
+        node = new_node(NODE_ALTERNATE, node, parse_concatenation(parser));
+    }
+    return node;
+}
+
+/**
+ * concatenation := repetition*
+ * @param parser pointer of an parser_t
+ * @return the node, NODE_EMPTY if there is no repetition
+ */
+static regexp_node_t *parse_concatenation(parser_t *parser) {
+    regexp_node_t *node = NULL;
+    while (*parser->p != '\0' && *parser->p != '|' && *parser->p != ')') {
+        regexp_node_t *repetition = parse_repetition(parser);
+        node = node == NULL ? repetition : new_node(NODE_CONCAT, node, repetition);
+    }
+    return node != NULL ? node : new_node(NODE_EMPTY, NULL, NULL);
+}
+
+/**
+ * repetition := atom ('*' | '+' | '?')*
+ * @param parser pointer of an parser_t
+ * @return the node
+ */
+static regexp_node_t *parse_repetition(parser_t *parser) {
+    regexp_node_t *node = parse_atom(parser);
+    while (1) {
+        if (*parser->p == '*') {
+            node = new_node(NODE_STAR, node, NULL);
+        } else if (*parser->p == '+') {
+            node = new_node(NODE_PLUS, node, NULL);
+        } else if (*parser->p == '?') {
+            node = new_node(NODE_QUESTION, node, NULL);
+        } else {
+            return node;
+        }
+        parser->p++;
+    }
+}
+
+/**
+ * atom := '(' alternation ')' | '[' class ']' | '.' | '^' | '$' | '\' c | c
+ * @param parser pointer of an parser_t
+ * @return the node
+ */
+static regexp_node_t *parse_atom(parser_t *parser) {
+    int c = *parser->p;
+    if (c == '(') {
+        parser->p++;
+        regexp_node_t *node = parse_alternation(parser);
+        if (*parser->p != ')') {
+            fail(parser, "Missing )");
+        }
+        parser->p++;
+        return node;
+    }
+    if (c == '*' || c == '+' || c == '?') {
+        fail(parser, "Nothing to repeat");
+    }
+
+    regexp_node_t *node = new_node(NODE_SET, NULL, NULL);
+    parser->p++;
+    if (c == '[') {
+        parse_class(parser, node);
+    } else if (c == '.') {
+        negate_set(node->set);
+    } else if (c == '^' || c == '$') {
+        ADD_SYMBOL(node->set, LINE_BOUNDARY);
+    } else if (c == '\\') {
+        if (!parse_escape(parser, node->set)) {
+            add_folded(node->set, *parser->p);
+        }
+        parser->p++;
+    } else {
+        add_folded(node->set, c);
+    }
+    return node;
+}
+
+/**
+ * Parses a class after its '[', with ranges and escapes; ']' first is a
+ * member.
+ * @param parser pointer of an parser_t
+ * @param node NODE_SET node
+ */
+static void parse_class(parser_t *parser, regexp_node_t *node) {
+    int negated = *parser->p == '^';
+    if (negated) {
+        parser->p++;
+    }
+    const unsigned char *first = parser->p;
+    while (*parser->p != ']' || parser->p == first) {
+        int c = *parser->p++;
+        if (c == '\0') {
+            parser->p--;
+            fail(parser, "Missing ]");
+        }
+        if (c == '\\') {
+            if (!parse_escape(parser, node->set)) {
+                add_folded(node->set, *parser->p);
+            }
+            parser->p++;
+        } else if (parser->p[0] == '-' && parser->p[1] != ']' && parser->p[1] != '\0') {
+            int last = parser->p[1], i;
+            if (last < c) {
+                fail(parser, "Invalid range");
+            }
+            for (i = c; i <= last; ++i) {
+                add_folded(node->set, i);
+            }
+            parser->p += 2;
+        } else {
+            add_folded(node->set, c);
+        }
+    }
+    parser->p++;
+    if (negated) {
+        negate_set(node->set);
+    }
+}
+
+/**
+ * Adds the class of an escape, \d \w \s or their negations, to a set.
+ * @param parser pointer of an parser_t, at the byte after the backslash
+ * @param set the set
+ * @return 1 if it is a class, 0 if the byte is a literal
+ */
+static int parse_escape(parser_t *parser, unsigned char *set) {
+    int c = *parser->p, i;
+    if (c == '\0') {
+        fail(parser, "Trailing \\");
+    }
+    int lower = tolower(c);
+    if (lower != 'd' && lower != 'w' && lower != 's') {
+        return 0;
+    }
+    unsigned char members[(SYMBOL_COUNT + 7) / 8];
+    memset(members, 0, sizeof(members));
+    for (i = 0; i < 256; ++i) {
+        if ((lower == 'd' && isdigit(i)) || (lower == 'w' && (isalnum(i) || i == '_')) ||
+            (lower == 's' && isspace(i))) {
+            add_folded(members, i);
+        }
+    }
+    if (c != lower) {
+        negate_set(members);
+    }
+    for (i = 0; i < (int) sizeof(members); ++i) {
+        set[i] |= members[i];
+    }
+    return 1;
+}
+
+/**
+ * Reports a syntax error and exits.
+ * @param parser pointer of an parser_t
+ * @param message what is wrong
+ */
+static void fail(const parser_t *parser, const char *message) {
+    fprintf(stderr, "[regexp] %s at %d of \"%s\".\n", message,
+            (int) ((const char *) parser->p - parser->expression) + 1, parser->expression);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Creates a node of a syntax tree.
+ * @param type type of the node
+ * @param left its child
+ * @param right its second child
+ * @return the node
+ */
+static regexp_node_t *new_node(int type, regexp_node_t *left, regexp_node_t *right) {
+    regexp_node_t *node = (regexp_node_t *) calloc(1, sizeof(regexp_node_t));
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+/**
+ * Deallocates a syntax tree.
+ * @param node its root
+ */
+static void free_node(regexp_node_t *node) {
+    if (node != NULL) {
+        free_node(node->left);
+        free_node(node->right);
+        free(node);
+    }
+}
+
+/**
+ * Adds a byte to a set, lower cased like the bytes it is matched to.
+ * @param set the set
+ * @param c the byte
+ */
+static void add_folded(unsigned char *set, int c) {
+    ADD_SYMBOL(set, tolower(c));
+}
+
+/**
+ * Negates a set of folded bytes. A newline and the line boundary are never
+ * in it.
+ * @param set the set
+ */
+static void negate_set(unsigned char *set) {
+    unsigned char negated[(SYMBOL_COUNT + 7) / 8];
+    memset(negated, 0, sizeof(negated));
+    int c;
+    for (c = 0; c < 256; ++c) {
+        if (tolower(c) == c && c != '\n' && !HAS_SYMBOL(set, c)) {
+            ADD_SYMBOL(negated, c);
+        }
+    }
+    memcpy(set, negated, sizeof(negated));
+}
+
+/**
+ * Finds the literals of the matches of a node.
+ * @param node the node
+ * @return its literals, to be freed with free_literals
+ */
+static literal_info_t find_literals(const regexp_node_t *node) {
+    literal_info_t info;
+    if (node->type == NODE_SET || node->type == NODE_EMPTY) {
+        int c, members = 0, member = 0;
+        for (c = 0; c < SYMBOL_COUNT && node->type == NODE_SET; ++c) {
+            if (HAS_SYMBOL(node->set, c)) {
+                members++;
+                member = c;
+            }
+        }
+        char single[2];
+        single[0] = (char) member;
+        single[1] = '\0';
+        if (node->type == NODE_EMPTY || (members == 1 && member == LINE_BOUNDARY)) {
+            single[0] = '\0'; /* matches no byte */
+        } else if (members != 1) {
+            info.exact = NULL;
+            info.prefix = join("", "");
+            info.suffix = join("", "");
+            info.must = join("", "");
+            return info;
+        }
+        info.exact = join(single, "");
+        info.prefix = join(single, "");
+        info.suffix = join(single, "");
+        info.must = join(single, "");
+        return info;
+    }
+
+    literal_info_t left = find_literals(node->left);
+    if (node->type == NODE_STAR || node->type == NODE_QUESTION) {
+        free_literals(&left);
+        info.exact = NULL;
+        info.prefix = join("", "");
+        info.suffix = join("", "");
+        info.must = join("", "");
+        return info;
+    }
+    if (node->type == NODE_PLUS) {
+        free(left.exact);
+        left.exact = NULL;
+        return left;
+    }
+
+    literal_info_t right = find_literals(node->right);
+    if (node->type == NODE_CONCAT) {
+        info.exact = left.exact != NULL && right.exact != NULL ? join(left.exact, right.exact) : NULL;
+        info.prefix = left.exact != NULL ? join(left.exact, right.prefix) : join(left.prefix, "");
+        info.suffix = right.exact != NULL ? join(left.suffix, right.exact) : join(right.suffix, "");
+        info.must = longest(join(left.must, ""), join(right.must, ""));
+        info.must = longest(info.must, join(left.suffix, right.prefix));
+        info.must = longest(info.must, join(info.prefix, ""));
+        info.must = longest(info.must, join(info.suffix, ""));
+    } else {
+        /* NODE_ALTERNATE, what both sides have in common */
+        size_t prefix = 0, suffix = 0;
+        size_t left_length = strlen(left.suffix), right_length = strlen(right.suffix);
+        while (left.prefix[prefix] != '\0' && left.prefix[prefix] == right.prefix[prefix]) {
+            prefix++;
+        }
+        while (suffix < left_length && suffix < right_length &&
+               left.suffix[left_length - 1 - suffix] == right.suffix[right_length - 1 - suffix]) {
+            suffix++;
+        }
+        info.exact = left.exact != NULL && right.exact != NULL && strcmp(left.exact, right.exact) == 0
+                     ? join(left.exact, "") : NULL;
+        info.prefix = join(left.prefix, "");
+        info.prefix[prefix] = '\0';
+        info.suffix = join(left.suffix + left_length - suffix, "");
+        info.must = longest(join(info.prefix, ""), join(info.suffix, ""));
+        if (strcmp(left.must, right.must) == 0) {
+            info.must = longest(info.must, join(left.must, ""));
+        }
+    }
+    free_literals(&left);
+    free_literals(&right);
+    return info;
+}
+
+/**
+ * Deallocates the literals of a node.
+ * @param info pointer of an literal_info_t
+ */
+static void free_literals(literal_info_t *info) {
+    free(info->exact);
+    free(info->prefix);
+    free(info->suffix);
+    free(info->must);
+}
+
+/**
+ * Concatenates two strings.
+ * @param a first string
+ * @param b second string
+ * @return malloc'ed a and b
+ */
+static char *join(const char *a, const char *b) {
+    size_t a_length = strlen(a), b_length = strlen(b);
+    char *joined = (char *) malloc(a_length + b_length + 1);
+    memcpy(joined, a, a_length);
+    memcpy(joined + a_length, b, b_length + 1);
+    return joined;
+}
+
+/**
+ * Keeps the longer of two malloc'ed strings and frees the other.
+ * @param a first string
+ * @param b second string
+ * @return the longer one, a if they are as long
+ */
+static char *longest(char *a, char *b) {
+    if (strlen(b) > strlen(a)) {
+        free(a);
+        return b;
+    }
+    free(b);
+    return a;
+}
+
+/**
+ * Adds a state to the NFA.
+ * @param regexp pointer of an regexp_t
+ * @param type type of the state
+ * @param out next state
+ * @param out1 second next state of NFA_SPLIT
+ * @param set symbols of NFA_SET
+ * @return index of the state
+ */
+static int add_state(regexp_t *regexp, int type, int out, int out1, const unsigned char *set) {
+    if (regexp->nfa_count == regexp->nfa_capacity) {
+        regexp->nfa_capacity = regexp->nfa_capacity ? regexp->nfa_capacity * 2 : 32;
+        regexp->nfa = (nfa_state_t *) realloc(regexp->nfa, sizeof(nfa_state_t) * regexp->nfa_capacity);
+    }
+    nfa_state_t *state = &regexp->nfa[regexp->nfa_count];
+    state->type = type;
+    state->out = out;
+    state->out1 = out1;
+    if (set != NULL) {
+        memcpy(state->set, set, sizeof(state->set));
+    } else {
+        memset(state->set, 0, sizeof(state->set));
+    }
+    return regexp->nfa_count++;
+}
+
+/**
+ * Builds the Thompson NFA of the reversal of a node: the same as its NFA,
+ * with the parts of every concatenation in the other order.
+ * @param regexp pointer of an regexp_t
+ * @param node the node
+ * @return the fragment of the node
+ */
+static fragment_t build_reversed(regexp_t *regexp, const regexp_node_t *node) {
+    fragment_t fragment, left, right;
+    if (node->type == NODE_SET || node->type == NODE_EMPTY) {
+        fragment.end = add_state(regexp, NFA_EMPTY, -1, -1, NULL);
+        fragment.start = node->type == NODE_EMPTY ? fragment.end
+                                                  : add_state(regexp, NFA_SET, fragment.end, -1, node->set);
+        return fragment;
+    }
+    if (node->type == NODE_CONCAT) {
+        right = build_reversed(regexp, node->right);
+        left = build_reversed(regexp, node->left);
+        regexp->nfa[right.end].out = left.start;
+        fragment.start = right.start;
+        fragment.end = left.end;
+        return fragment;
+    }
+    left = build_reversed(regexp, node->left);
+    fragment.end = add_state(regexp, NFA_EMPTY, -1, -1, NULL);
+    if (node->type == NODE_ALTERNATE) {
+        right = build_reversed(regexp, node->right);
+        fragment.start = add_state(regexp, NFA_SPLIT, left.start, right.start, NULL);
+        regexp->nfa[left.end].out = fragment.end;
+        regexp->nfa[right.end].out = fragment.end;
+    } else if (node->type == NODE_STAR) {
+        fragment.start = add_state(regexp, NFA_SPLIT, left.start, fragment.end, NULL);
+        regexp->nfa[left.end].out = fragment.start;
+    } else if (node->type == NODE_PLUS) {
+        fragment.start = left.start;
+        regexp->nfa[left.end].out = add_state(regexp, NFA_SPLIT, left.start, fragment.end, NULL);
+    } else {
+        fragment.start = add_state(regexp, NFA_SPLIT, left.start, fragment.end, NULL);
+        regexp->nfa[left.end].out = fragment.end;
+    }
+    return fragment;
+}
+
+/**
+ * Divides the symbols into classes that every NFA_SET state has all or
+ * none of, so the DFA has a transition per class instead of per byte.
+ * @param regexp pointer of an regexp_t
+ */
+static void find_classes(regexp_t *regexp) {
+    int class_of[SYMBOL_COUNT], split[2 * SYMBOL_COUNT];
+    int classes = 1, i, c;
+    memset(class_of, 0, sizeof(class_of));
+    for (i = 0; i < regexp->nfa_count; ++i) {
+        if (regexp->nfa[i].type != NFA_SET) {
+            continue;
+        }
+        int count = 0;
+        for (c = 0; c < 2 * classes; ++c) {
+            split[c] = -1;
+        }
+        for (c = 0; c < SYMBOL_COUNT; ++c) {
+            int key = class_of[c] * 2 + HAS_SYMBOL(regexp->nfa[i].set, c);
+            if (split[key] < 0) {
+                split[key] = count++;
+            }
+            class_of[c] = split[key];
+        }
+        classes = count;
+    }
+
+    regexp->classes = classes;
+    regexp->representative = (int *) malloc(sizeof(int) * classes);
+    for (c = SYMBOL_COUNT - 1; c >= 0; --c) {
+        regexp->representative[class_of[c]] = c;
+    }
+    for (c = 0; c < 256; ++c) {
+        regexp->class_of[c] = (unsigned short) class_of[tolower(c)];
+    }
+    regexp->boundary = class_of[LINE_BOUNDARY];
+}
+
+/**
+ * Finds the NFA_SET and NFA_MATCH states that are reached from some states
+ * without reading a symbol, into the closure scratch, sorted.
+ * @param regexp pointer of an regexp_t
+ * @param states the states
+ * @param count state count
+ * @return count of the states in the closure
+ */
+static int close_states(regexp_t *regexp, const int *states, int count) {
+    int depth = 0, size = 0, i;
+    regexp->generation++;
+    for (i = count - 1; i >= 0; --i) {
+        regexp->stack[depth++] = states[i];
+    }
+    while (depth > 0) {
+        int state = regexp->stack[--depth];
+        if (state < 0 || regexp->marks[state] == regexp->generation) {
+            continue;
+        }
+        regexp->marks[state] = regexp->generation;
+        const nfa_state_t *nfa = &regexp->nfa[state];
+        if (nfa->type == NFA_SET || nfa->type == NFA_MATCH) {
+            regexp->closure[size++] = state;
+        } else {
+            if (nfa->type == NFA_SPLIT) {
+                regexp->stack[depth++] = nfa->out1;
+            }
+            regexp->stack[depth++] = nfa->out;
+        }
+    }
+    qsort(regexp->closure, (size_t) size, sizeof(int), compare_states);
+    return size;
+}
+
+/**
+ * Finds the DFA state of the NFA states in the closure scratch, adding it
+ * if it is new.
+ * @param regexp pointer of an regexp_t
+ * @param count count of the NFA states
+ * @return the DFA state, -1 if the DFA is full
+ */
+static int find_dfa_state(regexp_t *regexp, int count) {
+    size_t hash = 2166136261u;
+    int i;
+    for (i = 0; i < count; ++i) {
+        hash = (hash ^ (size_t) regexp->closure[i]) * 16777619u;
+    }
+    size_t mask = 2 * DFA_MAX_STATES - 1, bucket = hash & mask;
+    while (regexp->dfa_hash[bucket] >= 0) {
+        int state = regexp->dfa_hash[bucket];
+        if (regexp->dfa_sizes[state] == count &&
+            memcmp(regexp->dfa_pool + regexp->dfa_offsets[state], regexp->closure, sizeof(int) * count) == 0) {
+            return state;
+        }
+        bucket = (bucket + 1) & mask;
+    }
+    if (regexp->dfa_count == DFA_MAX_STATES) {
+        return -1;
+    }
+
+    if (regexp->pool_length + (size_t) count > regexp->pool_capacity) {
+        regexp->pool_capacity = regexp->pool_capacity * 2 + (size_t) count + 64;
+        regexp->dfa_pool = (int *) realloc(regexp->dfa_pool, sizeof(int) * regexp->pool_capacity);
+    }
+    int state = regexp->dfa_count++;
+    memcpy(regexp->dfa_pool + regexp->pool_length, regexp->closure, sizeof(int) * count);
+    regexp->dfa_offsets[state] = regexp->pool_length;
+    regexp->dfa_sizes[state] = count;
+    regexp->pool_length += (size_t) count;
+    regexp->dfa_accepting[state] = 0;
+    for (i = 0; i < count; ++i) {
+        if (regexp->nfa[regexp->closure[i]].type == NFA_MATCH) {
+            regexp->dfa_accepting[state] = 1;
+        }
+    }
+    for (i = 0; i < regexp->classes; ++i) {
+        regexp->dfa_next[state * regexp->classes + i] = -1;
+    }
+    regexp->dfa_hash[bucket] = state;
+    return state;
+}
+
+/**
+ * Takes the transition of a DFA state on a class, building it if needed.
+ * When the DFA is full, it is cleared and the state reached is its first.
+ * @param regexp pointer of an regexp_t
+ * @param state the DFA state
+ * @param symbol_class the class
+ * @return the next DFA state
+ */
+static int step_dfa(regexp_t *regexp, int state, int symbol_class) {
+    int *edge = &regexp->dfa_next[state * regexp->classes + symbol_class];
+    if (*edge >= 0) {
+        return *edge;
+    }
+    int symbol = regexp->representative[symbol_class];
+    const int *states = regexp->dfa_pool + regexp->dfa_offsets[state];
+    int count = regexp->dfa_sizes[state], outs = 0, i;
+    int *next = (int *) malloc(sizeof(int) * (count + 1));
+    for (i = 0; i < count; ++i) {
+        const nfa_state_t *nfa = &regexp->nfa[states[i]];
+        if (nfa->type == NFA_SET && HAS_SYMBOL(nfa->set, symbol)) {
+            next[outs++] = nfa->out;
+        }
+    }
+    int size = close_states(regexp, next, outs);
+    free(next);
+    int found = find_dfa_state(regexp, size);
+    if (found < 0) {
+        clear_dfa(regexp);
+        return find_dfa_state(regexp, size); /* the closure is kept */
+    }
+    *edge = found;
+    return found;
+}
+
+/**
+ * Builds the DFA state that a line starts in, after the line boundary at
+ * its end.
+ * @param regexp pointer of an regexp_t
+ */
+static void start_dfa(regexp_t *regexp) {
+    int size = close_states(regexp, &regexp->start, 1);
+    int initial = find_dfa_state(regexp, size); /* the DFA is empty, it fits */
+    regexp->dfa_start = step_dfa(regexp, initial, regexp->boundary);
+}
+
+/**
+ * Drops every DFA state.
+ * @param regexp pointer of an regexp_t
+ */
+static void clear_dfa(regexp_t *regexp) {
+    int i;
+    for (i = 0; i < 2 * DFA_MAX_STATES; ++i) {
+        regexp->dfa_hash[i] = -1;
+    }
+    regexp->dfa_count = 0;
+    regexp->pool_length = 0;
+    regexp->dfa_start = -1;
+}
+
+/**
+ * Orders NFA states by their index.
+ * @param a pointer of an int
+ * @param b pointer of an int
+ * @return negative, zero or positive as a is before, same as or after b
+ */
+static int compare_states(const void *a, const void *b) {
+    return *(const int *) a - *(const int *) b;
+}
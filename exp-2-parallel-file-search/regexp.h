@@ -0,0 +1,56 @@
+#ifndef BBM342_EXP2_REGEXP_H
+#define BBM342_EXP2_REGEXP_H
+
+#include <stddef.h>
+
+#define DFA_MAX_STATES  4096    /* the DFA is built again from its start when it is full */
+#define SYMBOL_COUNT    257     /* bytes and the line boundary */
+#define LINE_BOUNDARY   256     /* symbol of ^ and $ */
+
+/* State of the NFA, see build_reversed */
+typedef struct nfa_state {
+    int type;               /* NFA_SET, NFA_SPLIT, NFA_EMPTY or NFA_MATCH */
+    int out;
+    int out1;               /* NFA_SPLIT */
+    unsigned char set[(SYMBOL_COUNT + 7) / 8];  /* NFA_SET, folded bytes and the line boundary */
+} nfa_state_t;
+
+/* Case-insensitive regular expression. Its reversed NFA is run backwards
+ * over a line as a DFA, which is built lazily and cached, so a regexp is
+ * used by one thread. */
+typedef struct regexp {
+    nfa_state_t *nfa;
+    int nfa_count;
+    int nfa_capacity;
+    int start;                      /* unanchored start of the reversed expression */
+    int classes;                    /* symbol classes */
+    unsigned short class_of[256];   /* class of every byte, folded */
+    int boundary;                   /* class of the line boundary */
+    int *representative;            /* a symbol of every class */
+    char *literal;                  /* folded, in every match, "" if none */
+
+    int dfa_count;
+    int dfa_start;                  /* after the boundary at the line end, -1 if not built */
+    int *dfa_next;                  /* DFA_MAX_STATES * classes transitions, -1 if not built */
+    char *dfa_accepting;
+    size_t *dfa_offsets;            /* NFA states of every DFA state in the pool */
+    int *dfa_sizes;
+    int *dfa_pool;
+    size_t pool_length;
+    size_t pool_capacity;
+    int *dfa_hash;                  /* 2 * DFA_MAX_STATES buckets, -1 if empty */
+
+    int *closure;                   /* scratch of the NFA walks */
+    int *stack;
+    int *marks;
+    int generation;
+    size_t *starts;                 /* match starts of a line */
+    size_t starts_capacity;
+} regexp_t;
+
+void compile_regexp(regexp_t *regexp, const char *expression);
+void free_regexp(regexp_t *regexp);
+char *required_literal(const char *expression);
+size_t match_line(regexp_t *regexp, const char *line, size_t length, const size_t **starts);
+
+#endif
@@ -0,0 +1,227 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * Shared memory result ring
+ *
+ * Result frames of a minion go to its controller through a ring in a
+ * memfd that both of them map, so the controller takes them in place,
+ * without a read or a copy for every frame. A frame is stored whole: if it
+ * does not fit before the end of the ring, the rest of the ring is skipped.
+ * The pipes carry only the batches of paths, and tell when a side is gone.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include "ring.h"
+
+#define FRAME_ALIGN(size) (((size) + 7) & ~(size_t) 7)
+#define MAPPING_SIZE (sizeof(ring_header_t) + RING_SIZE)
+
+static void map_ring(result_ring_t *ring);
+static int wait_event(result_ring_t *ring, int fd);
+static void post_event(int fd);
+
+/**
+ * Creates a ring for a minion, before it is forked. Its memfd is kept
+ * open for pass_ring.
+ * @param ring pointer of an result_ring_t
+ * @param peer read end of a pipe that the minion holds the write end of
+ */
+void create_ring(result_ring_t *ring, int peer) {
+    ring->memfd = memfd_create("bbm342-results", MFD_CLOEXEC);
+    ring->ready = eventfd(0, EFD_CLOEXEC);
+    ring->space = eventfd(0, EFD_CLOEXEC);
+    if (ring->memfd < 0 || ring->ready < 0 || ring->space < 0 ||
+        ftruncate(ring->memfd, (off_t) MAPPING_SIZE) < 0) {
+        fprintf(stderr, "[create-ring] memfd or eventfd failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    map_ring(ring);
+    ring->peer = peer;
+}
+
+/**
+ * Moves the descriptors of a ring to RING_FD, RING_READY_FD and
+ * RING_SPACE_FD in a forked minion, so that they are kept by exec.
+ * @param ring pointer of an result_ring_t
+ */
+void pass_ring(const result_ring_t *ring) {
+    int fds[3], i;
+    fds[0] = fcntl(ring->memfd, F_DUPFD, RING_SPACE_FD + 1); /* out of the way of dup2 */
+    fds[1] = fcntl(ring->ready, F_DUPFD, RING_SPACE_FD + 1);
+    fds[2] = fcntl(ring->space, F_DUPFD, RING_SPACE_FD + 1);
+    for (i = 0; i < 3; ++i) {
+        dup2(fds[i], RING_FD + i);
+        close(fds[i]);
+    }
+}
+
+/**
+ * Maps the ring that is passed to a minion.
+ * @param ring pointer of an result_ring_t
+ * @param peer a fd that hangs up when the controller is gone
+ */
+void attach_ring(result_ring_t *ring, int peer) {
+    ring->memfd = RING_FD;
+    ring->ready = RING_READY_FD;
+    ring->space = RING_SPACE_FD;
+    map_ring(ring);
+    close(ring->memfd); /* the mapping keeps it */
+    ring->memfd = -1;
+    ring->peer = peer;
+}
+
+/**
+ * Unmaps a ring and closes its descriptors.
+ * @param ring pointer of an result_ring_t
+ */
+void destroy_ring(result_ring_t *ring) {
+    munmap(ring->header, MAPPING_SIZE);
+    if (ring->memfd >= 0) {
+        close(ring->memfd);
+    }
+    close(ring->ready);
+    close(ring->space);
+}
+
+/**
+ * Writes a frame to the ring, waits while there is no room for it. Exits
+ * if the controller is gone.
+ * @param ring pointer of an result_ring_t
+ * @param frame frame header
+ * @param data bytes of the frame
+ */
+void write_ring(result_ring_t *ring, const result_frame_t *frame, const char *data) {
+    ring_header_t *header = ring->header;
+    size_t need = FRAME_ALIGN(sizeof(result_frame_t) + frame->length);
+    unsigned long long head = header->head;
+    size_t pos = (size_t) (head % RING_SIZE);
+    size_t skip = RING_SIZE - pos < need ? RING_SIZE - pos : 0;
+    unsigned long long end = head + skip + need;
+
+    while (end - __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE) > RING_SIZE) {
+        __atomic_store_n(&header->writer_waiting, 1, __ATOMIC_SEQ_CST);
+        if (end - __atomic_load_n(&header->tail, __ATOMIC_SEQ_CST) > RING_SIZE &&
+            !wait_event(ring, ring->space)) {
+            exit(EXIT_FAILURE); /* the controller is gone */
+        }
+        __atomic_store_n(&header->writer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    if (skip > 0) {
+        if (skip >= sizeof(result_frame_t)) {
+            ((result_frame_t *) (ring->data + pos))->kind = RESULT_SKIP;
+        }
+        pos = 0;
+    }
+    memcpy(ring->data + pos, frame, sizeof(result_frame_t));
+    memcpy(ring->data + pos + sizeof(result_frame_t), data, frame->length);
+    __atomic_store_n(&header->head, end, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&header->reader_waiting, __ATOMIC_SEQ_CST)) {
+        post_event(ring->ready);
+    }
+}
+
+/**
+ * Takes the next frame of the ring in place, waits while there is none.
+ * Its bytes follow it; it stays valid until it is released.
+ * @param ring pointer of an result_ring_t
+ * @return the frame, NULL if the minion is gone
+ */
+const result_frame_t *read_ring(result_ring_t *ring) {
+    ring_header_t *header = ring->header;
+    unsigned long long tail = header->tail;
+    while (1) {
+        while (__atomic_load_n(&header->head, __ATOMIC_ACQUIRE) == tail) {
+            __atomic_store_n(&header->reader_waiting, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&header->head, __ATOMIC_SEQ_CST) == tail && !wait_event(ring, ring->ready)) {
+                return NULL;
+            }
+            __atomic_store_n(&header->reader_waiting, 0, __ATOMIC_RELAXED);
+        }
+        size_t pos = (size_t) (tail % RING_SIZE);
+        const result_frame_t *frame = (const result_frame_t *) (ring->data + pos);
+        if (RING_SIZE - pos >= sizeof(result_frame_t) && frame->kind != RESULT_SKIP) {
+            return frame;
+        }
+        tail += RING_SIZE - pos; /* the frame is at the start */
+        __atomic_store_n(&header->tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Gives the room of a frame back to the minion.
+ * @param ring pointer of an result_ring_t
+ * @param frame the frame from read_ring
+ */
+void release_ring(result_ring_t *ring, const result_frame_t *frame) {
+    ring_header_t *header = ring->header;
+    __atomic_store_n(&header->tail, header->tail + FRAME_ALIGN(sizeof(result_frame_t) + frame->length),
+                     __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&header->writer_waiting, __ATOMIC_SEQ_CST)) {
+        post_event(ring->space);
+    }
+}
+
+/**
+ * Maps the memfd of a ring.
+ * @param ring pointer of an result_ring_t
+ */
+static void map_ring(result_ring_t *ring) {
+    void *mapping = mmap(NULL, MAPPING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, ring->memfd, 0);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "[map-ring] mmap failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    ring->header = (ring_header_t *) mapping;
+    ring->data = (char *) mapping + sizeof(ring_header_t);
+}
+
+/**
+ * Sleeps until an eventfd is written or the other side hangs up.
+ * @param ring pointer of an result_ring_t
+ * @param fd the eventfd
+ * @return 1 when the eventfd is written, 0 when the other side is gone
+ */
+static int wait_event(result_ring_t *ring, int fd) {
+    struct pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = ring->peer;
+    fds[1].events = 0; /* hang ups only, batches may wait in it */
+    while (1) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        if (fds[0].revents & POLLIN) {
+            eventfd_t value;
+            eventfd_read(fd, &value);
+            return 1;
+        }
+        if (fds[1].revents & (POLLHUP | POLLERR)) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * Wakes the other side of a ring.
+ * @param fd its eventfd
+ */
+static void post_event(int fd) {
+    eventfd_write(fd, 1);
+}
@@ -0,0 +1,47 @@
+#ifndef BBM342_EXP2_RING_H
+#define BBM342_EXP2_RING_H
+
+#include "protocol.h"
+
+#define RING_SIZE       (1 << 20)   /* bytes of result frames in a ring */
+
+/* File descriptors of the ring in a minion, see pass_ring */
+#define RING_FD         3
+#define RING_READY_FD   4
+#define RING_SPACE_FD   5
+
+/* Kind of the padding at the end of the ring, see write_ring */
+#define RESULT_SKIP     (-1)
+
+/* Shared header of a ring, the frames follow it. Positions count bytes
+ * from the start, the frame at a position is at position % RING_SIZE. */
+typedef struct ring_header {
+    unsigned long long head;        /* written up to, by the minion */
+    char head_line[56];             /* head and tail on their own cache lines */
+    unsigned long long tail;        /* read up to, by the controller */
+    char tail_line[56];
+    int reader_waiting;
+    int writer_waiting;
+} ring_header_t;
+
+/* Single producer, single consumer ring of result frames from a minion
+ * to its controller in a shared memfd. Each side sleeps on an eventfd that
+ * is written only when it says it is waiting. */
+typedef struct result_ring {
+    ring_header_t *header;
+    char *data;
+    int memfd;      /* -1 once it is mapped by the minion */
+    int ready;      /* eventfd, frames were written */
+    int space;      /* eventfd, frames were read */
+    int peer;       /* hangs up when the other side is gone */
+} result_ring_t;
+
+void create_ring(result_ring_t *ring, int peer);
+void pass_ring(const result_ring_t *ring);
+void attach_ring(result_ring_t *ring, int peer);
+void destroy_ring(result_ring_t *ring);
+void write_ring(result_ring_t *ring, const result_frame_t *frame, const char *data);
+const result_frame_t *read_ring(result_ring_t *ring);
+void release_ring(result_ring_t *ring, const result_frame_t *frame);
+
+#endif
@@ -0,0 +1,377 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * File search
+ *
+ * Searches the queries in a whole file or in a range of it, for a minion
+ * process or a worker thread of main. Results are collected in a result
+ * buffer and handed to its sink one frame at a time: the minion writes the
+ * frames to its pipe, a worker thread writes them to the log itself.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "scan.h"
+
+#define READ_CHUNK      (1 << 16)
+
+/* A match of an expression, see find_appended */
+typedef struct found_match {
+    const char *match;
+    int query;
+} found_match_t;
+
+/* Matches of expressions that are collected */
+typedef struct found_matches {
+    found_match_t *matches;
+    size_t count;
+    size_t capacity;
+} found_matches_t;
+
+/* Position of the line counting in a file, see report_match */
+typedef struct match_context {
+    FILE *out;
+    result_buffer_t *results;
+    char *id;
+    char *file;           /* file name in the output file */
+    const matcher_t *matcher;
+    const char *first;    /* matches start at or after this */
+    const char *limit;    /* matches start before this */
+    const char *after;    /* matches end after this */
+    const found_match_t *found;   /* expressions, matches before the append */
+    size_t found_count;
+    int ranged;           /* matches are sent as range_match_t records */
+    const char *line;     /* start of the line of the last match */
+    const char *counted;  /* newlines before this are counted */
+    int line_number;
+} match_context_t;
+
+static void report_match(void *context, const char *match, int query);
+static void collect_match(void *context, const char *match, int query);
+static int compare_found(const void *a, const void *b);
+
+/**
+ * Opens the output file of a minion and writes its header.
+ * @param id minion's id
+ * @param queries search queries
+ * @param query_count query count
+ * @return the output file
+ */
+FILE *open_output(const char *id, char **queries, int query_count) {
+    char output_file[24];
+    sprintf(output_file, "minion%s.out", id);
+    FILE* out = fopen(output_file, "w");
+
+    int i;
+    fprintf(out, "Search for ");
+    for (i = 0; i < query_count; ++i) {
+        fprintf(out, i == 0 ? "\"%s\"" : ", \"%s\"", queries[i]);
+    }
+    fprintf(out, " %s on Minion%s\n", query_count == 1 ? "string" : "strings", id);
+    fprintf(out, "----------------------\n");
+    return out;
+}
+
+/**
+ * Searches the queries in a whole file, or in a range of it, at once. Line
+ * numbers are found by counting newlines between matches only. A range
+ * owns the matches that start in it; it is scanned a query length further
+ * and its line numbers are counted from its start, see protocol.c. A range
+ * appended to a searched file owns the matches that end in it instead, the
+ * ones that start in the last line before it too. A match of an expression
+ * may be as long as its line, so the lines of a range are scanned whole;
+ * an appended range owns the matches that were not found before it.
+ * @param out output file descriptor
+ * @param id minion process' id
+ * @param matcher compiled search queries
+ * @param view file contents, its read buffer is kept between files
+ * @param results log lines or range matches for the controller
+ * @param file input file
+ * @param entry the range of the file
+ */
+void search_in_file(FILE *out, char *id, const matcher_t *matcher, file_view_t *view,
+                    result_buffer_t *results, char *file, const path_entry_t *entry) {
+    int ranged = entry->length >= 0;
+    if (ranged) {
+        if (results->length > 0) {
+            flush_results(results, 0, 0); /* lines of the files before */
+        }
+        results->kind = RESULT_MATCHES;
+    }
+
+    if (open_file_view(view, file) < 0) {
+        fprintf(stderr, "Cannot open the file.\n");
+        if (ranged) {
+            results->kind = RESULT_RANGE_END;
+            flush_results(results, 0, 0);
+            results->kind = RESULT_LINES;
+        }
+        return;
+    }
+
+    size_t size = view->length, start = 0, end = size, scan_start = 0, scan_end = size;
+    char *label = file;
+    found_matches_t found;
+    memset(&found, 0, sizeof(found));
+    if (ranged) {
+        size_t longest = 0;
+        int i;
+        for (i = 0; i < matcher->count; ++i) {
+            size_t query_length = strlen(matcher->queries[i]);
+            longest = query_length > longest ? query_length : longest;
+        }
+        if ((size_t) entry->file_size < size) {
+            size = (size_t) entry->file_size; /* grown after the range was made */
+        }
+        start = (size_t) entry->offset < size ? (size_t) entry->offset : size;
+        end = (size_t) (entry->offset + entry->length) < size ? (size_t) (entry->offset + entry->length) : size;
+        scan_start = start;
+        scan_end = longest > 0 && end + longest - 1 < size ? end + longest - 1 : size;
+        if (matcher->regex) {
+            const char *newline = start > 0 ? memrchr(view->data, '\n', start) : NULL;
+            scan_start = newline != NULL ? (size_t) (newline + 1 - view->data) : 0;
+            newline = end < size ? memchr(view->data + end, '\n', size - end) : NULL;
+            scan_end = newline != NULL ? (size_t) (newline - view->data) : size;
+            if (entry->appended && scan_start < start) {
+                /* found in the last line when the file ended at the range */
+                scan_matcher(matcher, view->data + scan_start, start - scan_start, collect_match, &found);
+                qsort(found.matches, found.count, sizeof(found_match_t), compare_found);
+            }
+        } else if (entry->appended && longest > 1) {
+            /* the lines of the range start at its line, whose start is not scanned */
+            scan_start = start > longest - 1 ? start - (longest - 1) : 0;
+            const char *newline = memrchr(view->data + scan_start, '\n', start - scan_start);
+            if (newline != NULL) {
+                scan_start = (size_t) (newline + 1 - view->data);
+            }
+        }
+
+        label = (char *) malloc(strlen(file) + 24);
+        sprintf(label, "%s@%lld", file, entry->offset);
+    }
+
+    match_context_t context;
+    context.out = out;
+    context.results = results;
+    context.id = id;
+    context.file = label;
+    context.matcher = matcher;
+    context.first = view->data + (matcher->regex && !entry->appended ? start : scan_start);
+    context.limit = view->data + end;
+    context.after = entry->appended ? view->data + start : NULL;
+    context.found = found.matches;
+    context.found_count = found.count;
+    context.ranged = ranged;
+    context.counted = view->data + scan_start;
+    context.line = start > 0 ? memrchr(view->data, '\n', start) : NULL;
+    context.line = context.line != NULL ? context.line + 1 : view->data;
+    context.line_number = 1;
+    scan_matcher(matcher, view->data + scan_start, scan_end - scan_start, report_match, &context);
+
+    if (ranged) {
+        long long newlines = context.line_number - 1;
+        const char *newline;
+        while (context.counted < context.limit &&
+               (newline = memchr(context.counted, '\n', context.limit - context.counted)) != NULL) {
+            newlines++;
+            context.counted = newline + 1;
+        }
+        results->kind = RESULT_RANGE_END;
+        flush_results(results, 0, newlines);
+        results->kind = RESULT_LINES;
+        free(label);
+        free(found.matches);
+    }
+
+    close_file_view(view);
+}
+
+/**
+ * Hands the collected results to the sink of the buffer as one frame.
+ * @param results pointer of an result_buffer_t
+ * @param done 1 if it is the last frame of a batch
+ * @param newlines newline count of the range, with RESULT_RANGE_END
+ */
+void flush_results(result_buffer_t *results, int done, long long newlines) {
+    result_frame_t frame;
+    frame.length = results->length;
+    frame.kind = results->kind;
+    frame.done = done;
+    frame.newlines = newlines;
+
+    results->sink(results->context, &frame, results->data);
+    results->length = 0;
+}
+
+/**
+ * Writes a match to the output file and to the results. Matches come in
+ * the order of their ends, so newlines are counted up to the end of the
+ * match; a query has no newline, so its line starts before the match.
+ * Matches of expressions come in the order of their lines and are counted
+ * up to their starts.
+ * @param context pointer of an match_context_t
+ * @param match start of the match
+ * @param query index of the matching query
+ */
+static void report_match(void *context, const char *match, int query) {
+    match_context_t *c = (match_context_t *) context;
+    if (match >= c->limit || match < c->first) {
+        return; /* belongs to the next or the last range */
+    }
+    const char *end = c->matcher->regex ? match : match + strlen(c->matcher->queries[query]);
+    if (c->after != NULL) {
+        found_match_t key;
+        key.match = match;
+        key.query = query;
+        if (c->matcher->regex ? bsearch(&key, c->found, c->found_count, sizeof(found_match_t), compare_found) != NULL
+                              : end <= c->after) {
+            return; /* found before the range was appended */
+        }
+    }
+    const char *newline;
+    while (c->counted < end && (newline = memchr(c->counted, '\n', end - c->counted)) != NULL) {
+        c->line_number++;
+        c->line = c->counted = newline + 1;
+    }
+    if (c->counted < end) {
+        c->counted = end;
+    }
+
+    long pos = match - c->line + 1;
+    const char *name = c->matcher->count == 1 ? NULL : c->matcher->queries[query];
+    if (c->ranged) {
+        char message[MESSAGE_SIZE];
+        fwrite(message, 1, (size_t) format_match(message, c->id, c->file, c->line_number, pos, name), c->out);
+
+        if (RESULT_FRAME_SIZE - c->results->length < sizeof(range_match_t)) {
+            flush_results(c->results, 0, 0);
+        }
+        range_match_t *record = (range_match_t *) (c->results->data + c->results->length);
+        record->line = c->line_number;
+        record->query = query;
+        record->column = pos;
+        c->results->length += sizeof(range_match_t);
+        return;
+    }
+
+    if (RESULT_FRAME_SIZE - c->results->length < MESSAGE_SIZE) {
+        flush_results(c->results, 0, 0);
+    }
+    char *message = c->results->data + c->results->length;
+    int message_size = format_match(message, c->id, c->file, c->line_number, pos, name);
+    fwrite(message, 1, (size_t) message_size, c->out);
+    c->results->length += (size_t) message_size;
+}
+
+/**
+ * Collects a match of an expression.
+ * @param context pointer of an found_matches_t
+ * @param match start of the match
+ * @param query index of the matching expression
+ */
+static void collect_match(void *context, const char *match, int query) {
+    found_matches_t *found = (found_matches_t *) context;
+    if (found->count == found->capacity) {
+        found->capacity = found->capacity ? found->capacity * 2 : 16;
+        found->matches = (found_match_t *) realloc(found->matches, sizeof(found_match_t) * found->capacity);
+    }
+    found->matches[found->count].match = match;
+    found->matches[found->count].query = query;
+    found->count++;
+}
+
+/**
+ * Orders matches by their start and expression.
+ * @param a pointer of an found_match_t
+ * @param b pointer of an found_match_t
+ * @return negative, zero or positive as a is before, same as or after b
+ */
+static int compare_found(const void *a, const void *b) {
+    const found_match_t *x = (const found_match_t *) a, *y = (const found_match_t *) b;
+    if (x->match != y->match) {
+        return x->match < y->match ? -1 : 1;
+    }
+    return x->query - y->query;
+}
+
+/**
+ * Maps a file into memory, or reads it into the buffer of the view if it is
+ * small or cannot be mapped. A view that is loaded by the reader of the
+ * minion already (see reader.c) is used as it is.
+ * @param view pointer of an file_view_t
+ * @param file path of the file
+ * @return 0 on success, -1 on error
+ */
+int open_file_view(file_view_t *view, const char *file) {
+    if (view->loaded) {
+        return 0;
+    }
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    view->mapped = 0;
+    view->length = 0;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size >= MMAP_THRESHOLD) {
+        void *data = mmap(NULL, (size_t) file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, (size_t) file_stat.st_size, MADV_SEQUENTIAL);
+            view->data = (char *) data;
+            view->length = (size_t) file_stat.st_size;
+            view->mapped = 1;
+            close(fd);
+            return 0;
+        }
+    }
+
+    while (1) {
+        if (view->capacity - view->length < READ_CHUNK) {
+            size_t capacity = view->capacity ? view->capacity * 2 : READ_CHUNK * 2;
+            char *buffer = (char *) realloc(view->buffer, capacity);
+            if (!buffer) {
+                close(fd);
+                return -1;
+            }
+            view->buffer = buffer;
+            view->capacity = capacity;
+        }
+        ssize_t r = read(fd, view->buffer + view->length, view->capacity - view->length);
+        if (r < 0) {
+            close(fd);
+            return -1;
+        }
+        if (r == 0) {
+            break;
+        }
+        view->length += (size_t) r;
+    }
+    view->data = view->buffer;
+    close(fd);
+    return 0;
+}
+
+/**
+ * Unmaps the file of a view. Its read buffer is kept, and so is the buffer
+ * of a loaded view, which is given back by release_file.
+ * @param view pointer of an file_view_t
+ */
+void close_file_view(file_view_t *view) {
+    if (view->mapped) {
+        munmap(view->data, view->length);
+        view->mapped = 0;
+    }
+    view->loaded = 0;
+    view->data = NULL;
+    view->length = 0;
+}
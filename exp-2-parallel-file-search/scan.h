@@ -0,0 +1,41 @@
+#ifndef BBM342_EXP2_SCAN_H
+#define BBM342_EXP2_SCAN_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "protocol.h"
+#include "search.h"
+
+#define MMAP_THRESHOLD  (1 << 16) /* smaller files are read, not mapped */
+
+/* Contents of a file, mapped or read into a buffer */
+typedef struct file_view {
+    char *data;
+    size_t length;
+    int mapped;
+    int loaded;       /* read into a buffer of the reader, see reader.c */
+    char *buffer;     /* read buffer of small files, kept between files */
+    size_t capacity;
+} file_view_t;
+
+/* Takes a frame of results, data holds frame->length bytes */
+typedef void (*result_sink_t)(void *context, const result_frame_t *frame, const char *data);
+
+/* Log lines or range matches that are not given to the sink yet */
+typedef struct result_buffer {
+    char data[RESULT_FRAME_SIZE];
+    size_t length;
+    int kind;         /* RESULT_LINES or RESULT_MATCHES */
+    result_sink_t sink;
+    void *context;
+} result_buffer_t;
+
+FILE *open_output(const char *id, char **queries, int query_count);
+void search_in_file(FILE *out, char *id, const matcher_t *matcher, file_view_t *view,
+                    result_buffer_t *results, char *input_file, const path_entry_t *entry);
+void flush_results(result_buffer_t *results, int done, long long newlines);
+int open_file_view(file_view_t *view, const char *file);
+void close_file_view(file_view_t *view);
+
+#endif
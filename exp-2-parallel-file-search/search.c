@@ -0,0 +1,477 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * Case-insensitive substring search
+ *
+ * The query is lower cased once. With SSE2, 16 candidate positions are
+ * checked at a time by comparing the first and the last byte of the query,
+ * folded with an OR of 0x20 when they are letters, and only the candidates
+ * are verified byte by byte. Without SSE2, Boyer-Moore-Horspool runs on a
+ * skip table of the folded query. Both fold like tolower in the C locale,
+ * so they find the same matches as lower casing the text and strstr.
+ *
+ * Several queries are searched in a single pass with an Aho-Corasick
+ * automaton whose transitions are a full table over classes of the folded
+ * bytes, so every byte of the text costs one lookup.
+ *
+ * Regular expressions (see regexp.c) are run only on the lines that have
+ * their required literals, which are found with find_pattern, so a search
+ * for an expression with a literal goes at close to the speed of the
+ * literal. Lines are visited in order, for every expression that may match
+ * in them.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "search.h"
+
+static unsigned char fold_table[256];
+static pthread_once_t fold_once = PTHREAD_ONCE_INIT; /* workers compile at the same time */
+
+static void scan_regexps(const matcher_t *matcher, const char *text, size_t length,
+                         match_callback_t callback, void *context);
+static const char *find_candidate(const matcher_t *matcher, int query, const char *text, const char *end);
+static void init_fold_table(void);
+static void fill_fold_table(void);
+static const char *find_horspool(const pattern_t *pattern, const unsigned char *text, size_t length);
+static int equals_folded(const unsigned char *folded, const unsigned char *text, size_t length);
+
+/**
+ * Lower cases a query and builds its skip table.
+ * @param pattern pointer of an pattern_t
+ * @param query search query
+ */
+void compile_pattern(pattern_t *pattern, const char *query) {
+    int c;
+    init_fold_table();
+
+    size_t i, length = strlen(query);
+    pattern->length = length;
+    pattern->folded = (unsigned char *) malloc(length + 1);
+    for (i = 0; i < length; ++i) {
+        pattern->folded[i] = fold_table[(unsigned char) query[i]];
+    }
+    pattern->folded[length] = '\0';
+
+    for (c = 0; c < 256; ++c) {
+        pattern->skip[c] = length;
+    }
+    for (i = 0; i + 1 < length; ++i) {
+        /* both cases of a letter shift the same */
+        pattern->skip[pattern->folded[i]] = length - 1 - i;
+        pattern->skip[toupper(pattern->folded[i])] = length - 1 - i;
+    }
+}
+
+/**
+ * Deallocates the lower cased query.
+ * @param pattern pointer of an pattern_t
+ */
+void free_pattern(pattern_t *pattern) {
+    free(pattern->folded);
+    pattern->folded = NULL;
+}
+
+/**
+ * Finds the first case-insensitive occurrence of a query in a text.
+ * @param pattern compiled query
+ * @param text text to search in, need not be null terminated
+ * @param length byte count of the text
+ * @return address of the match in the text, NULL if there is none or the
+ * query is empty
+ */
+const char *find_pattern(const pattern_t *pattern, const char *text, size_t length) {
+    size_t m = pattern->length;
+    if (m == 0 || m > length) {
+        return NULL;
+    }
+    const unsigned char *s = (const unsigned char *) text;
+
+#ifdef __SSE2__
+    unsigned char first = pattern->folded[0], last = pattern->folded[m - 1];
+    const __m128i first_byte = _mm_set1_epi8((char) first);
+    const __m128i last_byte = _mm_set1_epi8((char) last);
+    const __m128i first_fold = _mm_set1_epi8(isalpha(first) ? 0x20 : 0);
+    const __m128i last_fold = _mm_set1_epi8(isalpha(last) ? 0x20 : 0);
+
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= length; i += 16) {
+        __m128i head = _mm_loadu_si128((const __m128i *) (s + i));
+        __m128i tail = _mm_loadu_si128((const __m128i *) (s + i + m - 1));
+        __m128i hit = _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_or_si128(head, first_fold), first_byte),
+                _mm_cmpeq_epi8(_mm_or_si128(tail, last_fold), last_byte));
+        unsigned mask = (unsigned) _mm_movemask_epi8(hit);
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (m <= 2 || equals_folded(pattern->folded + 1, s + i + bit + 1, m - 2)) {
+                return text + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    /* fewer than 16 positions left */
+    return find_horspool(pattern, s + i, length - i);
+#else
+    return find_horspool(pattern, s, length);
+#endif
+}
+
+/**
+ * Builds the automaton of a set of queries. Empty queries never match.
+ * @param automaton pointer of an automaton_t
+ * @param queries search queries
+ * @param count query count
+ */
+void compile_automaton(automaton_t *automaton, char **queries, int count) {
+    init_fold_table();
+    int i, c;
+    size_t total = 0;
+    automaton->count = count;
+    automaton->lengths = (size_t *) malloc(sizeof(size_t) * count);
+    automaton->same_next = (int *) malloc(sizeof(int) * count);
+    for (i = 0; i < count; ++i) {
+        automaton->lengths[i] = strlen(queries[i]);
+        automaton->same_next[i] = -1;
+        total += automaton->lengths[i];
+    }
+
+    /* one class for every folded byte in the queries */
+    int class_id[256];
+    memset(class_id, 0, sizeof(class_id));
+    int classes = 1;
+    for (i = 0; i < count; ++i) {
+        const unsigned char *q = (const unsigned char *) queries[i];
+        for (; *q; ++q) {
+            if (class_id[fold_table[*q]] == 0) {
+                class_id[fold_table[*q]] = classes++;
+            }
+        }
+    }
+    for (c = 0; c < 256; ++c) {
+        automaton->class_of[c] = (unsigned char) class_id[fold_table[c]];
+    }
+    automaton->classes = classes;
+
+    /* trie of the queries */
+    int capacity = (int) total + 1;
+    automaton->next = (int *) malloc(sizeof(int) * capacity * classes);
+    automaton->output = (int *) malloc(sizeof(int) * capacity);
+    automaton->dictionary = (int *) calloc((size_t) capacity, sizeof(int));
+    int *fail = (int *) calloc((size_t) capacity, sizeof(int));
+    if (!automaton->next || !automaton->output || !automaton->dictionary || !fail) {
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < capacity * classes; ++i) {
+        automaton->next[i] = -1;
+    }
+    for (i = 0; i < capacity; ++i) {
+        automaton->output[i] = -1;
+    }
+    int states = 1;
+    for (i = 0; i < count; ++i) {
+        const unsigned char *q = (const unsigned char *) queries[i];
+        if (*q == '\0') {
+            continue;
+        }
+        int state = 0;
+        for (; *q; ++q) {
+            int *edge = &automaton->next[state * classes + automaton->class_of[*q]];
+            if (*edge < 0) {
+                *edge = states++;
+            }
+            state = *edge;
+        }
+        automaton->same_next[i] = automaton->output[state];
+        automaton->output[state] = i;
+    }
+    automaton->states = states;
+
+    /* breadth first, fill the missing transitions with the ones of the fail state */
+    int *queue = (int *) malloc(sizeof(int) * states);
+    int head = 0, tail = 0;
+    for (c = 0; c < classes; ++c) {
+        int *edge = &automaton->next[c];
+        if (*edge < 0) {
+            *edge = 0;
+        } else {
+            queue[tail++] = *edge;
+        }
+    }
+    while (head < tail) {
+        int state = queue[head++];
+        for (c = 0; c < classes; ++c) {
+            int *edge = &automaton->next[state * classes + c];
+            int fallback = automaton->next[fail[state] * classes + c];
+            if (*edge < 0) {
+                *edge = fallback;
+                continue;
+            }
+            int child = *edge;
+            fail[child] = fallback;
+            automaton->dictionary[child] = automaton->output[fallback] >= 0 ? fallback : automaton->dictionary[fallback];
+            queue[tail++] = child;
+        }
+    }
+    free(queue);
+    free(fail);
+}
+
+/**
+ * Deallocates the tables of an automaton.
+ * @param automaton pointer of an automaton_t
+ */
+void free_automaton(automaton_t *automaton) {
+    free(automaton->lengths);
+    free(automaton->same_next);
+    free(automaton->next);
+    free(automaton->output);
+    free(automaton->dictionary);
+    memset(automaton, 0, sizeof(automaton_t));
+}
+
+/**
+ * Finds every occurrence of every query in a text. Matches are reported in
+ * the order of their last bytes, longer ones first when they end together.
+ * @param automaton compiled queries
+ * @param text text to search in, need not be null terminated
+ * @param length byte count of the text
+ * @param callback called for every match
+ * @param context passed to the callback
+ */
+void scan_automaton(const automaton_t *automaton, const char *text, size_t length,
+                    match_callback_t callback, void *context) {
+    const unsigned char *s = (const unsigned char *) text;
+    const int *next = automaton->next;
+    const int *output = automaton->output;
+    int classes = automaton->classes;
+    int state = 0;
+
+    size_t i;
+    for (i = 0; i < length; ++i) {
+        state = next[state * classes + automaton->class_of[s[i]]];
+        int hit = output[state] >= 0 ? state : automaton->dictionary[state];
+        for (; hit > 0; hit = automaton->dictionary[hit]) {
+            int query;
+            for (query = output[hit]; query >= 0; query = automaton->same_next[query]) {
+                callback(context, text + i + 1 - automaton->lengths[query], query);
+            }
+        }
+    }
+}
+
+/**
+ * Compiles the queries of a search, a single one for find_pattern and
+ * several ones into an automaton. Regular expressions are compiled with
+ * their literals; their DFAs are built as they scan, so a matcher of them
+ * is used by one thread.
+ * @param matcher pointer of an matcher_t
+ * @param queries search queries, kept by the matcher
+ * @param count query count, at least 1
+ * @param regex 1 if the queries are regular expressions
+ */
+void compile_matcher(matcher_t *matcher, char **queries, int count, int regex) {
+    memset(matcher, 0, sizeof(matcher_t));
+    matcher->queries = queries;
+    matcher->count = count;
+    matcher->regex = regex;
+    if (regex) {
+        int i;
+        matcher->regexps = (regexp_t *) malloc(sizeof(regexp_t) * count);
+        matcher->literals = (pattern_t *) malloc(sizeof(pattern_t) * count);
+        for (i = 0; i < count; ++i) {
+            compile_regexp(&matcher->regexps[i], queries[i]);
+            compile_pattern(&matcher->literals[i], matcher->regexps[i].literal);
+        }
+    } else if (count == 1) {
+        compile_pattern(&matcher->pattern, queries[0]);
+    } else {
+        compile_automaton(&matcher->automaton, queries, count);
+    }
+}
+
+/**
+ * Deallocates the compiled queries.
+ * @param matcher pointer of an matcher_t
+ */
+void free_matcher(matcher_t *matcher) {
+    if (matcher->regex) {
+        int i;
+        for (i = 0; i < matcher->count; ++i) {
+            free_regexp(&matcher->regexps[i]);
+            free_pattern(&matcher->literals[i]);
+        }
+        free(matcher->regexps);
+        free(matcher->literals);
+    } else if (matcher->count == 1) {
+        free_pattern(&matcher->pattern);
+    } else {
+        free_automaton(&matcher->automaton);
+    }
+}
+
+/**
+ * Finds every occurrence of the queries in a text, overlapping ones too,
+ * or the start of every match of the expressions.
+ * @param matcher compiled queries
+ * @param text text to search in
+ * @param length byte count of the text
+ * @param callback called for every match
+ * @param context passed to the callback
+ * @see scan_automaton
+ */
+void scan_matcher(const matcher_t *matcher, const char *text, size_t length,
+                  match_callback_t callback, void *context) {
+    if (matcher->regex) {
+        scan_regexps(matcher, text, length, callback, context);
+        return;
+    }
+    if (matcher->count > 1) {
+        scan_automaton(&matcher->automaton, text, length, callback, context);
+        return;
+    }
+    const char *end = text + length;
+    const char *match = text;
+    while ((match = find_pattern(&matcher->pattern, match, end - match)) != NULL) {
+        callback(context, match, 0);
+        match++;
+    }
+}
+
+/**
+ * Finds the matches of regular expressions line by line. Every expression
+ * keeps the next place of its literal, and only the lines with one are
+ * matched, in order; an expression without a literal matches every line.
+ * @param matcher compiled expressions
+ * @param text text to search in
+ * @param length byte count of the text
+ * @param callback called for every match, in the order of the lines
+ * @param context passed to the callback
+ */
+static void scan_regexps(const matcher_t *matcher, const char *text, size_t length,
+                         match_callback_t callback, void *context) {
+    const char *end = text + length, *line = text;
+    const char **candidates = (const char **) malloc(sizeof(char *) * matcher->count);
+    int i;
+    for (i = 0; i < matcher->count; ++i) {
+        candidates[i] = find_candidate(matcher, i, line, end);
+    }
+    while (1) {
+        const char *first = NULL;
+        for (i = 0; i < matcher->count; ++i) {
+            if (candidates[i] != NULL && (first == NULL || candidates[i] < first)) {
+                first = candidates[i];
+            }
+        }
+        if (first == NULL) {
+            break;
+        }
+        const char *start = first > line ? memrchr(line, '\n', first - line) : NULL;
+        start = start != NULL ? start + 1 : line;
+        const char *stop = memchr(first, '\n', end - first);
+        stop = stop != NULL ? stop : end;
+
+        for (i = 0; i < matcher->count; ++i) {
+            if (candidates[i] != NULL && candidates[i] <= stop) {
+                const size_t *starts;
+                size_t count = match_line(&matcher->regexps[i], start, stop - start, &starts), k;
+                for (k = 0; k < count; ++k) {
+                    callback(context, start + starts[k], i);
+                }
+            }
+        }
+        if (stop == end) {
+            break;
+        }
+        line = stop + 1;
+        for (i = 0; i < matcher->count; ++i) {
+            if (candidates[i] != NULL && candidates[i] < line) {
+                candidates[i] = find_candidate(matcher, i, line, end);
+            }
+        }
+    }
+    free(candidates);
+}
+
+/**
+ * Finds the next place that an expression may match at.
+ * @param matcher compiled expressions
+ * @param query index of the expression
+ * @param text text to search in
+ * @param end end of the text
+ * @return its next literal, text if it has none, NULL if there is none
+ */
+static const char *find_candidate(const matcher_t *matcher, int query, const char *text, const char *end) {
+    if (text >= end) {
+        return NULL;
+    }
+    if (matcher->literals[query].length == 0) {
+        return text;
+    }
+    return find_pattern(&matcher->literals[query], text, end - text);
+}
+
+/**
+ * Fills the table of tolower in the C locale once, for every thread.
+ */
+static void init_fold_table(void) {
+    pthread_once(&fold_once, fill_fold_table);
+}
+
+/**
+ * Fills the table of tolower in the C locale.
+ */
+static void fill_fold_table(void) {
+    int c;
+    for (c = 0; c < 256; ++c) {
+        fold_table[c] = (unsigned char) tolower(c);
+    }
+}
+
+/**
+ * Boyer-Moore-Horspool search with the folded skip table.
+ * @param pattern compiled query
+ * @param text text to search in
+ * @param length byte count of the text
+ * @return address of the match in the text, NULL if there is none
+ */
+static const char *find_horspool(const pattern_t *pattern, const unsigned char *text, size_t length) {
+    size_t m = pattern->length;
+    size_t i = 0;
+    while (i + m <= length) {
+        unsigned char last = text[i + m - 1];
+        if (fold_table[last] == pattern->folded[m - 1] &&
+            equals_folded(pattern->folded, text + i, m - 1)) {
+            return (const char *) text + i;
+        }
+        i += pattern->skip[last];
+    }
+    return NULL;
+}
+
+/**
+ * Compares lower cased bytes to a text ignoring its case.
+ * @param folded lower cased bytes
+ * @param text text bytes
+ * @param length byte count
+ * @return 1 if they are equal, otherwise 0
+ */
+static int equals_folded(const unsigned char *folded, const unsigned char *text, size_t length) {
+    size_t i;
+    for (i = 0; i < length; ++i) {
+        if (fold_table[text[i]] != folded[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
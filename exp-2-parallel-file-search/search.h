@@ -0,0 +1,58 @@
+#ifndef BBM342_EXP2_SEARCH_H
+#define BBM342_EXP2_SEARCH_H
+
+#include <stddef.h>
+
+#include "regexp.h"
+
+/* Case-insensitive search query, compiled once per minion */
+typedef struct pattern {
+    unsigned char *folded;  /* lower case query */
+    size_t length;
+    size_t skip[256];       /* Horspool shifts of the folded bytes */
+} pattern_t;
+
+/* Case-insensitive Aho-Corasick automaton of several queries */
+typedef struct automaton {
+    int count;              /* query count */
+    size_t *lengths;        /* length of every query */
+    int *same_next;         /* next query that ends at the same state, -1 at the end */
+    int states;
+    int classes;            /* byte classes, 0 is the class of bytes in no query */
+    unsigned char class_of[256];
+    int *next;              /* states * classes transitions */
+    int *output;            /* first query that ends at a state, -1 if none */
+    int *dictionary;        /* nearest suffix state with an output, 0 if none */
+} automaton_t;
+
+/* One query with find_pattern, several with an automaton, or regular
+ * expressions whose lines are found by their literals first */
+typedef struct matcher {
+    char **queries;
+    int count;
+    int regex;              /* queries are regular expressions */
+    pattern_t pattern;      /* count == 1 */
+    automaton_t automaton;  /* count > 1 */
+    regexp_t *regexps;      /* regex, their DFAs are built as they scan */
+    pattern_t *literals;    /* regex, their required literals, length 0 if none */
+} matcher_t;
+
+/* Called for every match with the start of the match and the query index.
+ * A match of a query is in a line. */
+typedef void (*match_callback_t)(void *context, const char *match, int query);
+
+void compile_pattern(pattern_t *pattern, const char *query);
+void free_pattern(pattern_t *pattern);
+const char *find_pattern(const pattern_t *pattern, const char *text, size_t length);
+
+void compile_automaton(automaton_t *automaton, char **queries, int count);
+void free_automaton(automaton_t *automaton);
+void scan_automaton(const automaton_t *automaton, const char *text, size_t length,
+                    match_callback_t callback, void *context);
+
+void compile_matcher(matcher_t *matcher, char **queries, int count, int regex);
+void free_matcher(matcher_t *matcher);
+void scan_matcher(const matcher_t *matcher, const char *text, size_t length,
+                  match_callback_t callback, void *context);
+
+#endif
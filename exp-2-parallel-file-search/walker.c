@@ -0,0 +1,326 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * Parallel directory traversal
+ *
+ * A pool of walker threads reads directories with getdents64 and checks
+ * entries without a d_type with fstatat relative to the directory fd.
+ * Every thread keeps its directories in its own queue and works on them
+ * depth first; a thread without work steals the oldest directory of
+ * another one. Directory paths are built once in a per-thread arena and
+ * freed when the walk ends, so only the paths of txt files are allocated
+ * one by one, for the buffer.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "walker.h"
+
+#define ENTRIES_SIZE    (1 << 15) /* bytes of a getdents64 call */
+#define ARENA_BLOCK     (1 << 16)
+#define FOUND_BATCH     64        /* txt files reported at once */
+
+/* Directory entry of getdents64, its name follows the header */
+typedef struct linux_dirent64 {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+} linux_dirent64_t;
+
+static void* walker_routine(void* args);
+static void read_directory(walker_thread_t *self, const char *path);
+static const char *next_directory(walker_thread_t *self);
+static void push_directory(walker_thread_t *self, const char *path);
+static const char *take_directory(dir_queue_t *queue, int steal);
+static char *arena_path(path_arena_t *arena, const char *dir, size_t dir_length, const char *name);
+static void free_arena(path_arena_t *arena);
+
+/**
+ * Walks a directory tree with a pool of threads and reports its txt files.
+ * Returns when every directory is read.
+ * @param path root directory
+ * @param threads walker thread count
+ * @param found called from the walker threads with every txt file
+ * @param context passed to found
+ */
+void walk_tree(const char *path, int threads, found_callback_t found, void *context) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        fprintf(stderr, "[searcher-thread] Cannot open path.\n");
+        exit(1);
+    }
+    close(fd);
+
+    walker_t walker;
+    walker.count = threads < 1 ? 1 : threads;
+    walker.threads = (walker_thread_t *) calloc((size_t) walker.count, sizeof(walker_thread_t));
+    pthread_mutex_init(&walker.lock, NULL);
+    pthread_cond_init(&walker.work, NULL);
+    walker.queued = 0;
+    walker.pending = 0;
+    walker.found = found;
+    walker.context = context;
+
+    int i;
+    for (i = 0; i < walker.count; ++i) {
+        walker_thread_t *self = &walker.threads[i];
+        self->walker = &walker;
+        self->index = i;
+        pthread_mutex_init(&self->queue.mutex, NULL);
+        self->entries = (char *) malloc(ENTRIES_SIZE);
+    }
+    push_directory(&walker.threads[0], arena_path(&walker.threads[0].arena, path, strlen(path), NULL));
+
+    for (i = 0; i < walker.count; ++i) {
+        pthread_create(&walker.threads[i].thread, NULL, walker_routine, (void *) &walker.threads[i]);
+    }
+    for (i = 0; i < walker.count; ++i) {
+        walker_thread_t *self = &walker.threads[i];
+        pthread_join(self->thread, NULL);
+        pthread_mutex_destroy(&self->queue.mutex);
+        free(self->queue.items);
+        free(self->entries);
+        free_arena(&self->arena);
+    }
+    pthread_mutex_destroy(&walker.lock);
+    pthread_cond_destroy(&walker.work);
+    free(walker.threads);
+}
+
+/**
+ * Checks if a filename for a txt file.
+ * @param name file name as a string
+ * @return 1 if string ends with '.txt', otherwise 0;
+ */
+int is_txt(const char *name) {
+    size_t length = strlen(name);
+    return length > 4 && strcmp(name + length - 4, ".txt") == 0;
+}
+
+/**
+ * Subroutine for walker threads.
+ * Reads directories until every directory of the tree is read.
+ * @param args pointer of an walker_thread_t
+ * @return NULL
+ */
+static void* walker_routine(void* args) {
+    walker_thread_t *self = (walker_thread_t *) args;
+    walker_t *walker = self->walker;
+
+    const char *path;
+    while ((path = next_directory(self)) != NULL) {
+        read_directory(self, path);
+
+        pthread_mutex_lock(&walker->lock);
+        if (--walker->pending == 0) {
+            pthread_cond_broadcast(&walker->work); /* the walk is over */
+        }
+        pthread_mutex_unlock(&walker->lock);
+    }
+    return NULL;
+}
+
+/**
+ * Reports the txt files of a directory and queues its sub directories.
+ * @param self the walker thread
+ * @param path path of the directory
+ */
+static void read_directory(walker_thread_t *self, const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        fprintf(stderr, "[walker-thread] Cannot open %s.\n", path);
+        return;
+    }
+    size_t path_length = strlen(path);
+    char *found[FOUND_BATCH];
+    int found_count = 0;
+
+    long size;
+    while ((size = syscall(SYS_getdents64, fd, self->entries, ENTRIES_SIZE)) > 0) {
+        long offset = 0;
+        while (offset < size) {
+            linux_dirent64_t *entry = (linux_dirent64_t *) (self->entries + offset);
+            const char *name = (const char *) entry + offsetof(linux_dirent64_t, d_type) + 1;
+            offset += entry->d_reclen;
+
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            /* some filesystems do not provide d_type */
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat path_stat;
+                if (fstatat(fd, name, &path_stat, 0) == 0) {
+                    type = S_ISDIR(path_stat.st_mode) ? DT_DIR : (S_ISREG(path_stat.st_mode) ? DT_REG : DT_UNKNOWN);
+                }
+            }
+
+            if (type == DT_DIR) {
+                push_directory(self, arena_path(&self->arena, path, path_length, name));
+            } else if (type == DT_REG && is_txt(name)) {
+                size_t name_length = strlen(name);
+                char *file = (char *) malloc(path_length + name_length + 2);
+                memcpy(file, path, path_length);
+                file[path_length] = '/';
+                memcpy(file + path_length + 1, name, name_length + 1);
+                found[found_count++] = file;
+                if (found_count == FOUND_BATCH) {
+                    self->walker->found(self->walker->context, found, found_count);
+                    found_count = 0;
+                }
+            }
+        }
+    }
+    if (found_count > 0) {
+        self->walker->found(self->walker->context, found, found_count);
+    }
+    close(fd);
+}
+
+/**
+ * Takes the next directory of a thread: its own newest one, the oldest one
+ * of another thread, or waits for one.
+ * @param self the walker thread
+ * @return path of the directory, NULL when the walk is over
+ */
+static const char *next_directory(walker_thread_t *self) {
+    walker_t *walker = self->walker;
+    while (1) {
+        const char *path = take_directory(&self->queue, 0);
+        int i;
+        for (i = 1; path == NULL && i < walker->count; ++i) {
+            path = take_directory(&walker->threads[(self->index + i) % walker->count].queue, 1);
+        }
+
+        pthread_mutex_lock(&walker->lock);
+        if (path != NULL) {
+            walker->queued--;
+            pthread_mutex_unlock(&walker->lock);
+            return path;
+        }
+        while (walker->queued == 0 && walker->pending > 0) {
+            pthread_cond_wait(&walker->work, &walker->lock);
+        }
+        int over = walker->pending == 0;
+        pthread_mutex_unlock(&walker->lock);
+        if (over) {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Queues a directory to the tail of the queue of a thread.
+ * @param self the walker thread
+ * @param path path of the directory
+ */
+static void push_directory(walker_thread_t *self, const char *path) {
+    dir_queue_t *queue = &self->queue;
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count == queue->capacity) {
+        int capacity = queue->capacity ? queue->capacity * 2 : 64;
+        const char **items = (const char **) malloc(sizeof(char *) * capacity);
+        int i;
+        for (i = 0; i < queue->count; ++i) {
+            items[i] = queue->items[(queue->head + i) % queue->capacity];
+        }
+        free(queue->items);
+        queue->items = items;
+        queue->head = 0;
+        queue->capacity = capacity;
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = path;
+    queue->count++;
+    pthread_mutex_unlock(&queue->mutex);
+
+    walker_t *walker = self->walker;
+    pthread_mutex_lock(&walker->lock);
+    walker->queued++;
+    walker->pending++;
+    pthread_cond_signal(&walker->work);
+    pthread_mutex_unlock(&walker->lock);
+}
+
+/**
+ * Takes a directory from a queue.
+ * @param queue pointer of an dir_queue_t
+ * @param steal 1 to take the oldest directory, 0 to take the newest one
+ * @return path of the directory, NULL if the queue is empty
+ */
+static const char *take_directory(dir_queue_t *queue, int steal) {
+    const char *path = NULL;
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count > 0) {
+        if (steal) {
+            path = queue->items[queue->head];
+            queue->head = (queue->head + 1) % queue->capacity;
+        } else {
+            path = queue->items[(queue->head + queue->count - 1) % queue->capacity];
+        }
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return path;
+}
+
+/**
+ * Builds "dir/name" in an arena.
+ * @param arena pointer of an path_arena_t
+ * @param dir directory path
+ * @param dir_length length of the directory path
+ * @param name entry name, NULL for the directory itself
+ * @return the path, valid until the arena is freed
+ */
+static char *arena_path(path_arena_t *arena, const char *dir, size_t dir_length, const char *name) {
+    size_t name_length = name ? strlen(name) : 0;
+    size_t size = dir_length + name_length + 2;
+
+    arena_block_t *block = arena->blocks;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+        block = (arena_block_t *) malloc(sizeof(arena_block_t) + block_size);
+        if (!block) {
+            exit(EXIT_FAILURE);
+        }
+        block->next = arena->blocks;
+        block->used = 0;
+        block->size = block_size;
+        arena->blocks = block;
+    }
+
+    char *path = (char *) (block + 1) + block->used;
+    block->used += size;
+    memcpy(path, dir, dir_length);
+    if (name) {
+        path[dir_length] = '/';
+        memcpy(path + dir_length + 1, name, name_length + 1);
+    } else {
+        path[dir_length] = '\0';
+    }
+    return path;
+}
+
+/**
+ * Frees every block of an arena.
+ * @param arena pointer of an path_arena_t
+ */
+static void free_arena(path_arena_t *arena) {
+    while (arena->blocks) {
+        arena_block_t *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef BBM342_EXP2_WALKER_H
+#define BBM342_EXP2_WALKER_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* Called with txt files found, the paths are malloc'ed for the callee */
+typedef void (*found_callback_t)(void *context, char **paths, int count);
+
+/* Block of the path arena, its bytes follow the header */
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t used;
+    size_t size;
+} arena_block_t;
+
+/* Directory paths of a walker thread, freed at once when the walk ends */
+typedef struct path_arena {
+    arena_block_t *blocks;
+} path_arena_t;
+
+/* Directories of a walker thread. The owner works on the tail (depth
+ * first), idle threads steal from the head (the biggest subtrees). */
+typedef struct dir_queue {
+    pthread_mutex_t mutex;
+    const char **items;
+    int head;
+    int count;
+    int capacity;
+} dir_queue_t;
+
+typedef struct walker walker_t;
+
+typedef struct walker_thread {
+    walker_t *walker;
+    int index;
+    pthread_t thread;
+    dir_queue_t queue;
+    path_arena_t arena;
+    char *entries;      /* getdents64 buffer */
+} walker_thread_t;
+
+struct walker {
+    int count;
+    walker_thread_t *threads;
+    pthread_mutex_t lock;   /* queued and pending */
+    pthread_cond_t work;
+    int queued;             /* directories in the queues */
+    int pending;            /* queued directories and the ones being read */
+    found_callback_t found;
+    void *context;
+};
+
+void walk_tree(const char *path, int threads, found_callback_t found, void *context);
+int is_txt(const char *name);
+
+#endif
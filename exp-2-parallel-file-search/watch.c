@@ -0,0 +1,336 @@
+/**
+ * BBM 342: Operating Systems (Spring 2017)
+ * Experiment 2
+ * Watch mode
+ *
+ * After the first search, every directory of the tree is watched with
+ * inotify and the txt files that are created or modified are searched
+ * again. Files are expected to grow by appends: a file keeps an open split
+ * (see jobs.c) and the bytes after its last size are put as a new range,
+ * so its matches continue with the right line numbers. A file that shrinks
+ * is searched again from its start.
+ *
+ * @author Halil Ibrahim Sener <b21328447@cs.hacettepe.edu.tr>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+
+#define WATCH_MASK  (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+#define EVENTS_SIZE (1 << 16) /* bytes of an inotify read */
+
+static void add_watches(watch_t *watch, const char *path);
+static void remove_watches(watch_t *watch, const char *path);
+static void forget_files(watch_t *watch, const char *path, int directory);
+static void handle_event(watch_t *watch, const struct inotify_event *event);
+static watched_file_t **find_file(watch_t *watch, const char *path);
+static char *join_path(const char *directory, const char *name);
+static int is_under(const char *path, const char *directory);
+static size_t hash_path(const char *path);
+
+/**
+ * Creates an inotify instance and watches every directory of a tree. It
+ * is done before the first walk, so no change after it is missed.
+ * @param watch pointer of an watch_t
+ * @param path root of the tree
+ * @param walkers walker threads of a walk after an overflow
+ * @param buffer file buffer
+ * @param range_size byte count of a range, 0 for one range per change
+ * @param found takes txt files of new directories
+ * @param context context of found
+ */
+void open_watch(watch_t *watch, const char *path, int walkers, buffer_t *buffer, long long range_size,
+                found_callback_t found, void *context) {
+    memset(watch, 0, sizeof(watch_t));
+    watch->fd = inotify_init1(IN_CLOEXEC);
+    if (watch->fd < 0) {
+        fprintf(stderr, "[watch] inotify_init1 failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    watch->path = path;
+    watch->walkers = walkers;
+    pthread_mutex_init(&watch->lock, NULL);
+    watch->files_capacity = 1024;
+    watch->files = (watched_file_t **) calloc(watch->files_capacity, sizeof(watched_file_t *));
+    watch->buffer = buffer;
+    watch->range_size = range_size;
+    watch->found = found;
+    watch->context = context;
+    add_watches(watch, path);
+}
+
+/**
+ * Searches the bytes of a file after its last size. A new file is searched
+ * from its start, and so is a file that shrinks.
+ * @param watch pointer of an watch_t
+ * @param path path of the file, owned by the watch
+ * @param size byte count of the file
+ */
+void watch_file(watch_t *watch, char *path, long long size) {
+    pthread_mutex_lock(&watch->lock);
+    watched_file_t **slot = find_file(watch, path);
+    watched_file_t *file = *slot;
+    if (file != NULL && size < file->split->size) {
+        *slot = file->next;
+        watch->files_count--;
+        close_split(file->split);
+        free(file);
+        file = NULL;
+    }
+
+    int appended = file != NULL;
+    if (file == NULL) {
+        if (watch->files_count >= watch->files_capacity) {
+            /* rehash to twice the buckets */
+            size_t capacity = watch->files_capacity * 2, i;
+            watched_file_t **files = (watched_file_t **) calloc(capacity, sizeof(watched_file_t *));
+            for (i = 0; i < watch->files_capacity; ++i) {
+                while (watch->files[i] != NULL) {
+                    watched_file_t *next = watch->files[i]->next;
+                    size_t bucket = hash_path(watch->files[i]->split->path) % capacity;
+                    watch->files[i]->next = files[bucket];
+                    files[bucket] = watch->files[i];
+                    watch->files[i] = next;
+                }
+            }
+            free(watch->files);
+            watch->files = files;
+            watch->files_capacity = capacity;
+        }
+        size_t bucket = hash_path(path) % watch->files_capacity;
+        file = (watched_file_t *) malloc(sizeof(watched_file_t));
+        file->split = create_split(path);
+        file->next = watch->files[bucket];
+        watch->files[bucket] = file;
+        watch->files_count++;
+    } else {
+        free(path);
+    }
+    put_ranges(watch->buffer, file->split, size, watch->range_size, appended);
+    pthread_mutex_unlock(&watch->lock);
+}
+
+/**
+ * Reads inotify events and searches the changes, forever.
+ * @param watch pointer of an watch_t
+ */
+void run_watch(watch_t *watch) {
+    char *events = (char *) malloc(EVENTS_SIZE); /* aligned for inotify_event */
+    while (1) {
+        ssize_t length = read(watch->fd, events, EVENTS_SIZE);
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "[watch] read failed.\n");
+            exit(EXIT_FAILURE);
+        }
+        ssize_t offset = 0;
+        while (offset < length) {
+            const struct inotify_event *event = (const struct inotify_event *) (events + offset);
+            handle_event(watch, event);
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+/**
+ * Searches a changed file, or walks a new directory. Events of a directory
+ * that is gone are dropped with it; after an overflow the whole tree is
+ * walked again and every file is checked for appends.
+ * @param watch pointer of an watch_t
+ * @param event inotify event
+ */
+static void handle_event(watch_t *watch, const struct inotify_event *event) {
+    if (event->mask & IN_Q_OVERFLOW) {
+        add_watches(watch, watch->path);
+        walk_tree(watch->path, watch->walkers, watch->found, watch->context);
+        return;
+    }
+    if (event->wd < 0 || event->wd >= watch->directories_capacity || watch->directories[event->wd] == NULL) {
+        return;
+    }
+    if (event->mask & IN_IGNORED) {
+        free(watch->directories[event->wd]);
+        watch->directories[event->wd] = NULL;
+        return;
+    }
+    if (event->len == 0) {
+        return;
+    }
+
+    char *path = join_path(watch->directories[event->wd], event->name);
+    if (event->mask & IN_ISDIR) {
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            add_watches(watch, path);
+            walk_tree(path, 1, watch->found, watch->context);
+        } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            remove_watches(watch, path);
+            forget_files(watch, path, 1);
+        }
+        free(path);
+    } else if (is_txt(event->name)) {
+        struct stat file_stat;
+        if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            forget_files(watch, path, 0);
+            free(path);
+        } else if (stat(path, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+            watch_file(watch, path, (long long) file_stat.st_size);
+        } else {
+            free(path);
+        }
+    } else {
+        free(path);
+    }
+}
+
+/**
+ * Watches a directory and every directory under it.
+ * @param watch pointer of an watch_t
+ * @param path path of the directory
+ */
+static void add_watches(watch_t *watch, const char *path) {
+    int wd = inotify_add_watch(watch->fd, path, WATCH_MASK);
+    if (wd < 0) {
+        fprintf(stderr, "[watch] Cannot watch %s.\n", path);
+        return;
+    }
+    if (wd >= watch->directories_capacity) {
+        int capacity = watch->directories_capacity ? watch->directories_capacity : 64;
+        while (capacity <= wd) {
+            capacity *= 2;
+        }
+        watch->directories = (char **) realloc(watch->directories, capacity * sizeof(char *));
+        memset(watch->directories + watch->directories_capacity, 0,
+               (capacity - watch->directories_capacity) * sizeof(char *));
+        watch->directories_capacity = capacity;
+    }
+    free(watch->directories[wd]); /* watched already, maybe moved */
+    watch->directories[wd] = strdup(path);
+
+    DIR *directory = opendir(path);
+    if (directory == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        char *child = join_path(path, name);
+        struct stat child_stat;
+        if (entry->d_type == DT_DIR ||
+            (entry->d_type == DT_UNKNOWN && stat(child, &child_stat) == 0 && S_ISDIR(child_stat.st_mode))) {
+            add_watches(watch, child);
+        }
+        free(child);
+    }
+    closedir(directory);
+}
+
+/**
+ * Stops watching a directory that is gone and the directories under it.
+ * @param watch pointer of an watch_t
+ * @param path path of the directory
+ */
+static void remove_watches(watch_t *watch, const char *path) {
+    int wd;
+    for (wd = 0; wd < watch->directories_capacity; ++wd) {
+        if (watch->directories[wd] != NULL && is_under(watch->directories[wd], path)) {
+            inotify_rm_watch(watch->fd, wd);
+            free(watch->directories[wd]);
+            watch->directories[wd] = NULL;
+        }
+    }
+}
+
+/**
+ * Drops a file that is gone, or every file under a directory that is gone.
+ * A file with the same path later is a new file.
+ * @param watch pointer of an watch_t
+ * @param path path of the file or the directory
+ * @param directory 1 if path is a directory
+ */
+static void forget_files(watch_t *watch, const char *path, int directory) {
+    pthread_mutex_lock(&watch->lock);
+    size_t bucket = directory ? 0 : hash_path(path) % watch->files_capacity;
+    size_t last = directory ? watch->files_capacity : bucket + 1;
+    for (; bucket < last; ++bucket) {
+        watched_file_t **slot = &watch->files[bucket];
+        while (*slot != NULL) {
+            watched_file_t *file = *slot;
+            if (directory ? is_under(file->split->path, path) : strcmp(file->split->path, path) == 0) {
+                *slot = file->next;
+                watch->files_count--;
+                close_split(file->split);
+                free(file);
+            } else {
+                slot = &file->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&watch->lock);
+}
+
+/**
+ * Finds the slot of a file in the hash table. Called with the lock.
+ * @param watch pointer of an watch_t
+ * @param path path of the file
+ * @return the link to the file, or the NULL link at the end of its bucket
+ */
+static watched_file_t **find_file(watch_t *watch, const char *path) {
+    watched_file_t **slot = &watch->files[hash_path(path) % watch->files_capacity];
+    while (*slot != NULL && strcmp((*slot)->split->path, path) != 0) {
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+/**
+ * Joins a directory path and a name the way the walker does.
+ * @param directory path of the directory
+ * @param name name in the directory
+ * @return malloc'ed path
+ */
+static char *join_path(const char *directory, const char *name) {
+    size_t directory_length = strlen(directory), name_length = strlen(name);
+    char *path = (char *) malloc(directory_length + name_length + 2);
+    memcpy(path, directory, directory_length);
+    path[directory_length] = '/';
+    memcpy(path + directory_length + 1, name, name_length + 1);
+    return path;
+}
+
+/**
+ * Checks if a path is a directory or under it.
+ * @param path a path
+ * @param directory path of the directory
+ * @return 1 if it is, otherwise 0
+ */
+static int is_under(const char *path, const char *directory) {
+    size_t length = strlen(directory);
+    return strncmp(path, directory, length) == 0 && (path[length] == '\0' || path[length] == '/');
+}
+
+/**
+ * FNV-1a hash of a path
+ * @param path a path
+ * @return its hash
+ */
+static size_t hash_path(const char *path) {
+    size_t hash = 2166136261u;
+    while (*path != '\0') {
+        hash = (hash ^ (unsigned char) *path++) * 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,40 @@
+#ifndef BBM342_EXP2_WATCH_H
+#define BBM342_EXP2_WATCH_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "buffer.h"
+#include "jobs.h"
+#include "walker.h"
+
+/* A watched file and the split that its appends go to */
+typedef struct watched_file {
+    file_split_t *split;    /* its path is the key */
+    struct watched_file *next;
+} watched_file_t;
+
+/* Watch of a directory tree. The files searched so far are kept in a hash
+ * table by path; a file that grows is searched from its last size only. */
+typedef struct watch {
+    int fd;                     /* inotify instance */
+    const char *path;
+    int walkers;
+    char **directories;         /* directory of every watch descriptor */
+    int directories_capacity;
+    pthread_mutex_t lock;       /* the files, puts of their ranges */
+    watched_file_t **files;
+    size_t files_capacity;
+    size_t files_count;
+    buffer_t *buffer;
+    long long range_size;
+    found_callback_t found;     /* takes txt files of new directories */
+    void *context;
+} watch_t;
+
+void open_watch(watch_t *watch, const char *path, int walkers, buffer_t *buffer, long long range_size,
+                found_callback_t found, void *context);
+void watch_file(watch_t *watch, char *path, long long size);
+void run_watch(watch_t *watch);
+
+#endif